@@ -0,0 +1,66 @@
+# Binary Keypoints
+#
+# Reads the ############_keypointsD.bin files RealSense to OpenPose 3D writes with output=binary or output=both
+# The layout is described at the top of RealSense2OpenPose3D/source/BinaryKeypoints.hpp: a 48 byte little-endian header,
+#  then float32 x, y, z (meters), confidence records, the same number for every person
+# Usage:
+#  frame = readKeypoints("000000000000_keypointsD.bin")
+#  frame.points[person, keypoint] is [x, y, z, confidence], frame.part("pose") is every person's pose keypoints
+
+import numpy as np #The records are mapped straight into an array
+
+
+magic = b"RS3D"
+version = 1
+partNames = ["pose", "face", "hand_left", "hand_right"] #In the order they are in every person
+
+headerType = np.dtype([
+    ("magic", "S4"),
+    ("version", "<u2"),
+    ("partCount", "<u2"),
+    ("frameId", "<u8"),
+    ("timestampMs", "<f8"), #Milliseconds since 1970, estimated time the color image was taken
+    ("people", "<u4"),
+    ("keypointsPerPerson", "<u4"),
+    ("partKeypoints", "<u4", (4,)),
+])
+
+
+#One binary keypoint file
+class KeypointFrame:
+    def __init__(self, header, points):
+        self.frameId = int(header["frameId"])
+        self.timestampMs = float(header["timestampMs"])
+        self.partKeypoints = [int(count) for count in header["partKeypoints"]]
+        self.points = points #people x keypoints per person x 4 float32
+
+    #Every person's keypoints of one part, people x keypoints x 4
+    def part(self, name):
+        index = partNames.index(name)
+        start = sum(self.partKeypoints[:index])
+        return self.points[:, start:start + self.partKeypoints[index]]
+
+
+#Define Read Keypoints
+#Reads a binary keypoint file, raises ValueError if it isn't one
+#path: the .bin file
+#mapped: map the records from the file instead of reading them into memory (read only, good for large files)
+def readKeypoints(path, mapped=False):
+    header = np.fromfile(path, dtype=headerType, count=1)
+    if len(header) != 1 or header[0]["magic"] != magic:
+        raise ValueError("\"" + path + "\" is not a binary keypoint file")
+    header = header[0]
+    if header["version"] != version or header["partCount"] != len(partNames):
+        raise ValueError("\"" + path + "\" is version " + str(header["version"]) + ", this reader only knows version " + str(version))
+
+    shape = (int(header["people"]), int(header["keypointsPerPerson"]), 4)
+    if shape[0] * shape[1] == 0: #Nothing to map
+        points = np.zeros(shape, dtype="<f4")
+    elif mapped:
+        points = np.memmap(path, dtype="<f4", mode="r", offset=headerType.itemsize, shape=shape)
+    else:
+        points = np.fromfile(path, dtype="<f4", count=shape[0] * shape[1] * 4, offset=headerType.itemsize)
+        if points.size != shape[0] * shape[1] * 4:
+            raise ValueError("\"" + path + "\" is shorter than its header says")
+        points = points.reshape(shape)
+    return KeypointFrame(header, points)
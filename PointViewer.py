@@ -15,11 +15,13 @@ import time
 import os #For checking if next file exists or not yet
 
 import json #Used to read the JSON output files
+import BinaryKeypoints #Used to read the binary output files (output=binary)
 
 
 #Global variables
 outputPath = ""
 fileEnd = "_keypointsD.json"
+binaryFileEnd = "_keypointsD.bin" #Read when there are no JSON files
 
 frameNumber = 0 #Keeps track of what file should be read
 
@@ -93,14 +95,35 @@ def getFrame(i):
     digitNumberCurrent = len(str(frameNumber)) #Get number of digits of the frame number
     zerosCurrent = ""
     zerosCurrent = zerosCurrent.zfill(12-digitNumberCurrent)
-    fileNameCurrent = outputPath + "\\" + zerosCurrent + str(frameNumber) + fileEnd #Put file name together
+    fileNameCurrent = outputPath + "\\" + zerosCurrent + str(frameNumber) #Put file name together, without its ending
     #Next file name/path
     digitNumberNext = len(str(frameNumber+1)) #Get number of digits of the frame number
     zerosNext = ""
     zerosNext = zerosNext.zfill(12-digitNumberNext)
-    fileNameNext = outputPath + "\\" + zerosNext + str(frameNumber+1) + fileEnd #Put file name together
+    fileNameNext = outputPath + "\\" + zerosNext + str(frameNumber+1) #Put file name together, without its ending
     
-    if (os.path.isfile(fileNameNext) == True): #If the next frame exists, load this frame, otherwise do nothing
+    if (os.path.isfile(fileNameNext + fileEnd) == False and os.path.isfile(fileNameNext + binaryFileEnd) == True): #Only binary files
+        frameNumber += 1 #Increment the frame for next round
+        
+        #Every person's pose and face points, people x keypoints x [x, y, z, confidence]
+        frame = BinaryKeypoints.readKeypoints(fileNameCurrent + binaryFileEnd)
+        points = frame.points[:, 0:frame.partKeypoints[0] + frame.partKeypoints[1]]
+        numPeople = points.shape[0]
+        
+        #Only points with a depth greater than 0 and less than depthLim, one list per person
+        pointcloudX = []
+        pointcloudY = []
+        pointcloudZ = []
+        for person in range(0, numPeople):
+            near = points[person][(points[person, :, 2] > 0) & (points[person, :, 2] < depthLim)]
+            pointcloudX.append(near[:, 0])
+            pointcloudY.append(near[:, 1])
+            pointcloudZ.append(near[:, 2])
+        
+        if(numPeople > 0): #If there is any data in this frame
+            plotFrame(numPeople)
+    
+    elif (os.path.isfile(fileNameNext + fileEnd) == True): #If the next frame exists, load this frame, otherwise do nothing
         frameNumber += 1 #Increment the frame for next round
         
         #Empty the lists for each dimention
@@ -109,7 +132,7 @@ def getFrame(i):
         pointcloudZ = []
     
         #Open files
-        with open(fileNameCurrent, "r") as jFile:
+        with open(fileNameCurrent + fileEnd, "r") as jFile:
             data = jFile.read()
         
             
@@ -145,13 +168,20 @@ def getFrame(i):
                         pointcloudZ[person].append(faceDepth)
             
             
-            ax.clear() #Clear the plot
-            ax.set_ylim([0,depthLim]) #Set the scale of the axes, see near top of file for limit declairations
-            ax.set_xlim(leftRightLim)
-            ax.set_zlim(upDownLim)
-            ax.invert_zaxis()
-            for person in range(0, numPeople):
-                ax.scatter(pointcloudX[person], pointcloudZ[person], pointcloudY[person]) #Plot the points, note that y and z are swaped for easy viewing
+            plotFrame(numPeople)
+
+
+#Define Plot Frame
+#Replaces the plot with the points in pointcloudX, pointcloudY, and pointcloudZ
+#numPeople: how many people (lists) there are in each
+def plotFrame(numPeople):
+    ax.clear() #Clear the plot
+    ax.set_ylim([0,depthLim]) #Set the scale of the axes, see near top of file for limit declairations
+    ax.set_xlim(leftRightLim)
+    ax.set_zlim(upDownLim)
+    ax.invert_zaxis()
+    for person in range(0, numPeople):
+        ax.scatter(pointcloudX[person], pointcloudZ[person], pointcloudY[person]) #Plot the points, note that y and z are swaped for easy viewing
 
 
 if __name__ == '__main__':
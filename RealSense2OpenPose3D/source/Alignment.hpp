@@ -0,0 +1,623 @@
+//Full frame depth alignment for RealSense to OpenPose 3D
+//
+//DepthAligner does the same job as rs2::align (depth -> color) without the software device round trip. Every depth
+//  pixel's top-left and bottom-right corners are sent into the color image and the rectangle between them is filled
+//  with the pixel's depth, keeping the nearest depth where rectangles overlap (z-buffer).
+//  The corner rays are precomputed, and 8 depth pixels are mapped at a time with AVX2 when the CPU supports it, or 4
+//  at a time with SSE2 otherwise. All paths use the same operations in the same order as rsutil.h, so the output
+//  matches rs2::align bit for bit, as long as that rsutil.h is the one librealsense was built with (the vector paths
+//  copy its math, see Distortion.hpp). verify=replay checks every path against rs2::align on a recording.
+//  With a WorkerPool the depth image is split into row bands (tiles). Every tile writes into its own z-buffer, and the
+//  tile z-buffers are then merged by color row bands, so no two threads ever write the same memory.
+//
+//SdkAligner is the original method kept as a reference: the depth frame and the baseline color frame are injected
+//  into a software device, matched by a syncer, and aligned with rs2::align.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include <librealsense2/rs.hpp>
+#include <librealsense2/rsutil.h>
+#include <librealsense2/hpp/rs_internal.hpp>
+
+#include "./WorkerPool.hpp" //Threads for tiled alignment
+#include "./Simd.hpp" //AVX2 detection
+
+
+enum AlignPath
+{
+    ALIGN_SCALAR,
+    ALIGN_SSE2,
+    ALIGN_AVX2
+};
+
+const char* const alignPathNames[] = { "scalar code", "SSE2", "AVX2" };
+
+
+
+struct RowSpan
+{
+    int first; //First and last color rows written, first > last if nothing was written
+    int last;
+};
+
+
+
+class DepthAligner
+{
+public:
+    DepthAligner(const rs2_intrinsics& depthIntrin, const rs2_intrinsics& colorIntrin, const rs2_extrinsics& depth2ColorExtrin,
+        float depthUnits, AlignPath fastest = ALIGN_AVX2); //fastest: the fastest path to use if the CPU and color model allow it
+
+    void align(const uint16_t* depthData, uint16_t* aligned) const; //aligned is a Z16 image the size of the color image
+    void alignTiled(const uint16_t* depthData, uint16_t* aligned, WorkerPool& pool); //Same result, one tile per pool thread
+
+    AlignPath path() const { return alignPath; }
+    size_t tileMemoryBytes() const; //Size of the per-tile z-buffers
+
+private:
+    void alignRows(const uint16_t* depthData, int firstRow, int endRow, uint16_t* aligned, RowSpan& written) const;
+    void alignRowsScalar(const uint16_t* depthData, int firstRow, int endRow, uint16_t* aligned, RowSpan& written) const;
+    void alignPixel(const uint16_t* depthData, int x, int y, uint16_t* aligned, RowSpan& written) const;
+    void fillFootprint(uint16_t depthValue, int x0, int y0, int x1, int y1, uint16_t* aligned, RowSpan& written) const;
+    void mergeTileRows(int firstRow, int endRow, uint16_t* aligned);
+#ifdef SIMD_SSE2
+    void alignRowsSse2(const uint16_t* depthData, int firstRow, int endRow, uint16_t* aligned, RowSpan& written) const;
+#endif
+#ifdef SIMD_X86
+    SIMD_AVX2 void alignRowsAvx2(const uint16_t* depthData, int firstRow, int endRow, uint16_t* aligned, RowSpan& written) const;
+#endif
+
+    rs2_intrinsics depthIntrinsics;
+    rs2_intrinsics colorIntrinsics;
+    rs2_extrinsics depth2Color;
+    float depthScale;
+    int cornerStride; //Depth width + 1
+    std::vector<float> cornerX; //Ray (at 1 meter) through every depth pixel corner, (width + 1) x (height + 1)
+    std::vector<float> cornerY;
+    AlignPath alignPath;
+    std::vector<std::vector<uint16_t>> tileBuffers; //One color-sized z-buffer per tile, kept clear between frames
+    std::vector<RowSpan> tileRows; //Rows each tile wrote this frame
+};
+
+
+
+inline DepthAligner::DepthAligner(const rs2_intrinsics& depthIntrin, const rs2_intrinsics& colorIntrin, const rs2_extrinsics& depth2ColorExtrin,
+    float depthUnits, AlignPath fastest)
+    : depthIntrinsics(depthIntrin), colorIntrinsics(colorIntrin), depth2Color(depth2ColorExtrin), depthScale(depthUnits)
+{
+    //Same deprojection as rs2::align does per pixel, at 1 meter. Scaling by the depth later gives the same bits.
+    cornerStride = depthIntrinsics.width + 1;
+    cornerX.resize((size_t)cornerStride * (depthIntrinsics.height + 1));
+    cornerY.resize(cornerX.size());
+
+    float pixel[2], ray[3];
+    for (int y = 0; y <= depthIntrinsics.height; y++)
+    {
+        for (int x = 0; x <= depthIntrinsics.width; x++)
+        {
+            pixel[0] = x - 0.5f; //Corner (x, y) is the top-left of pixel (x, y)
+            pixel[1] = y - 0.5f;
+            rs2_deproject_pixel_to_point(ray, &depthIntrinsics, pixel, 1.0f);
+            cornerX[(size_t)y * cornerStride + x] = ray[0];
+            cornerY[(size_t)y * cornerStride + x] = ray[1];
+        }
+    }
+
+    //The vector path only knows the color models whose projection has no transcendental functions
+    bool simdModel = colorIntrinsics.model == RS2_DISTORTION_NONE
+        || colorIntrinsics.model == RS2_DISTORTION_INVERSE_BROWN_CONRADY
+        || colorIntrinsics.model == RS2_DISTORTION_MODIFIED_BROWN_CONRADY;
+    alignPath = ALIGN_SCALAR;
+#ifdef SIMD_SSE2
+    if (simdModel && fastest >= ALIGN_SSE2)
+    {
+        alignPath = ALIGN_SSE2;
+    }
+#endif
+#ifdef SIMD_X86
+    if (simdModel && fastest >= ALIGN_AVX2 && cpuHasAvx2())
+    {
+        alignPath = ALIGN_AVX2;
+    }
+#endif
+}//DepthAligner()
+
+
+
+//Aligns a whole Z16 depth frame to the color image
+inline void DepthAligner::align(const uint16_t* depthData, uint16_t* aligned) const
+{
+    std::memset(aligned, 0, sizeof(uint16_t) * colorIntrinsics.width * colorIntrinsics.height); //0 = no depth
+
+    RowSpan written = { colorIntrinsics.height, -1 };
+    alignRows(depthData, 0, depthIntrinsics.height, aligned, written);
+}//align()
+
+
+
+//Aligns the depth frame in row bands, one per pool thread, then merges the bands' z-buffers
+inline void DepthAligner::alignTiled(const uint16_t* depthData, uint16_t* aligned, WorkerPool& pool)
+{
+    int tileCount = pool.size();
+    if (tileCount <= 1)
+    {
+        align(depthData, aligned);
+        return;
+    }
+
+    if ((int)tileBuffers.size() != tileCount) //First frame, or the pool changed
+    {
+        tileBuffers.assign(tileCount, std::vector<uint16_t>((size_t)colorIntrinsics.width * colorIntrinsics.height, 0));
+        tileRows.resize(tileCount);
+    }
+
+    //Map every depth row band into its own z-buffer
+    pool.parallelFor(tileCount, [&](int tile) {
+        int firstRow = depthIntrinsics.height * tile / tileCount;
+        int endRow = depthIntrinsics.height * (tile + 1) / tileCount;
+        tileRows[tile] = { colorIntrinsics.height, -1 };
+        alignRows(depthData, firstRow, endRow, tileBuffers[tile].data(), tileRows[tile]);
+    });
+
+    //Merge the tiles, split by color rows so every thread owns its part of the output
+    pool.parallelFor(tileCount, [&](int band) {
+        mergeTileRows(colorIntrinsics.height * band / tileCount, colorIntrinsics.height * (band + 1) / tileCount, aligned);
+    });
+}//alignTiled()
+
+
+
+//Takes the nearest depth of all tiles for the given color rows and clears those rows in the tiles for the next frame
+inline void DepthAligner::mergeTileRows(int firstRow, int endRow, uint16_t* aligned)
+{
+    const int width = colorIntrinsics.width;
+    for (int y = firstRow; y < endRow; y++)
+    {
+        uint16_t* out = aligned + (size_t)y * width;
+        bool first = true;
+
+        for (size_t tile = 0; tile < tileBuffers.size(); tile++)
+        {
+            if (y < tileRows[tile].first || y > tileRows[tile].last) //This tile did not reach this row
+            {
+                continue;
+            }
+
+            uint16_t* in = tileBuffers[tile].data() + (size_t)y * width;
+            if (first)
+            {
+                std::memcpy(out, in, sizeof(uint16_t) * width);
+                first = false;
+            }
+            else
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    //Minimum where 0 (no depth) counts as the largest value: subtracting 1 wraps 0 around to 65535
+                    uint16_t a = (uint16_t)(out[x] - 1);
+                    uint16_t b = (uint16_t)(in[x] - 1);
+                    out[x] = (uint16_t)((a < b ? a : b) + 1);
+                }
+            }
+            std::memset(in, 0, sizeof(uint16_t) * width);
+        }
+
+        if (first) //No tile wrote to this row
+        {
+            std::memset(out, 0, sizeof(uint16_t) * width);
+        }
+    }
+}//mergeTileRows()
+
+
+
+inline size_t DepthAligner::tileMemoryBytes() const
+{
+    size_t bytes = 0;
+    for (const std::vector<uint16_t>& buffer : tileBuffers)
+    {
+        bytes += buffer.size() * sizeof(uint16_t);
+    }
+    return bytes;
+}//tileMemoryBytes()
+
+
+
+inline void DepthAligner::alignRows(const uint16_t* depthData, int firstRow, int endRow, uint16_t* aligned, RowSpan& written) const
+{
+#ifdef SIMD_X86
+    if (alignPath == ALIGN_AVX2)
+    {
+        alignRowsAvx2(depthData, firstRow, endRow, aligned, written);
+        return;
+    }
+#endif
+#ifdef SIMD_SSE2
+    if (alignPath == ALIGN_SSE2)
+    {
+        alignRowsSse2(depthData, firstRow, endRow, aligned, written);
+        return;
+    }
+#endif
+    alignRowsScalar(depthData, firstRow, endRow, aligned, written);
+}//alignRows()
+
+
+
+inline void DepthAligner::alignRowsScalar(const uint16_t* depthData, int firstRow, int endRow, uint16_t* aligned, RowSpan& written) const
+{
+    for (int y = firstRow; y < endRow; y++)
+    {
+        for (int x = 0; x < depthIntrinsics.width; x++)
+        {
+            alignPixel(depthData, x, y, aligned, written);
+        }
+    }
+}//alignRowsScalar()
+
+
+
+//Maps one depth pixel's corners into the color image with the rsutil.h functions and fills the rectangle between them
+inline void DepthAligner::alignPixel(const uint16_t* depthData, int x, int y, uint16_t* aligned, RowSpan& written) const
+{
+    uint16_t depthValue = depthData[y * depthIntrinsics.width + x];
+    if (depthValue == 0) //No data
+    {
+        return;
+    }
+    float depth = depthScale * depthValue;
+
+    float depthPoint[3], colorPoint[3], colorPixel[2];
+    size_t corner = (size_t)y * cornerStride + x;
+
+    depthPoint[0] = depth * cornerX[corner]; //Top-left corner
+    depthPoint[1] = depth * cornerY[corner];
+    depthPoint[2] = depth;
+    rs2_transform_point_to_point(colorPoint, &depth2Color, depthPoint);
+    rs2_project_point_to_pixel(colorPixel, &colorIntrinsics, colorPoint);
+    int x0 = (int)(colorPixel[0] + 0.5f);
+    int y0 = (int)(colorPixel[1] + 0.5f);
+
+    corner += cornerStride + 1; //Bottom-right corner
+    depthPoint[0] = depth * cornerX[corner];
+    depthPoint[1] = depth * cornerY[corner];
+    depthPoint[2] = depth;
+    rs2_transform_point_to_point(colorPoint, &depth2Color, depthPoint);
+    rs2_project_point_to_pixel(colorPixel, &colorIntrinsics, colorPoint);
+    int x1 = (int)(colorPixel[0] + 0.5f);
+    int y1 = (int)(colorPixel[1] + 0.5f);
+
+    fillFootprint(depthValue, x0, y0, x1, y1, aligned, written);
+}//alignPixel()
+
+
+
+//Writes a depth value into every color pixel of a footprint, keeping the nearest value (z-buffer)
+inline void DepthAligner::fillFootprint(uint16_t depthValue, int x0, int y0, int x1, int y1, uint16_t* aligned, RowSpan& written) const
+{
+    if (x0 < 0 || y0 < 0 || x1 >= colorIntrinsics.width || y1 >= colorIntrinsics.height) //Footprints leaving the image are dropped, like rs2::align
+    {
+        return;
+    }
+
+    written.first = std::min(written.first, y0);
+    written.last = std::max(written.last, y1);
+
+    for (int y = y0; y <= y1; y++)
+    {
+        uint16_t* row = aligned + y * colorIntrinsics.width;
+        for (int x = x0; x <= x1; x++)
+        {
+            if (row[x] == 0 || depthValue < row[x])
+            {
+                row[x] = depthValue;
+            }
+        }
+    }
+}//fillFootprint()
+
+
+
+#ifdef SIMD_X86
+//Projects 8 points at once into the color image. Same operations, in the same order, as rs2_transform_point_to_point()
+//  and rs2_project_point_to_pixel(), so every lane rounds exactly like the scalar path.
+SIMD_AVX2 inline void projectCorners8(const rs2_extrinsics& extrin, const rs2_intrinsics& intrin, __m256 depth, __m256 rayX, __m256 rayY,
+    __m256i& pixelX, __m256i& pixelY)
+{
+    const float* r = extrin.rotation;
+    __m256 px = _mm256_mul_ps(depth, rayX);
+    __m256 py = _mm256_mul_ps(depth, rayY);
+    __m256 pz = depth;
+
+    __m256 ox = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(r[0]), px), _mm256_mul_ps(_mm256_set1_ps(r[3]), py)),
+        _mm256_mul_ps(_mm256_set1_ps(r[6]), pz)), _mm256_set1_ps(extrin.translation[0]));
+    __m256 oy = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(r[1]), px), _mm256_mul_ps(_mm256_set1_ps(r[4]), py)),
+        _mm256_mul_ps(_mm256_set1_ps(r[7]), pz)), _mm256_set1_ps(extrin.translation[1]));
+    __m256 oz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(r[2]), px), _mm256_mul_ps(_mm256_set1_ps(r[5]), py)),
+        _mm256_mul_ps(_mm256_set1_ps(r[8]), pz)), _mm256_set1_ps(extrin.translation[2]));
+
+    __m256 x = _mm256_div_ps(ox, oz);
+    __m256 y = _mm256_div_ps(oy, oz);
+
+    if (intrin.model == RS2_DISTORTION_INVERSE_BROWN_CONRADY || intrin.model == RS2_DISTORTION_MODIFIED_BROWN_CONRADY)
+    {
+        const float* c = intrin.coeffs;
+        __m256 one = _mm256_set1_ps(1.0f);
+        __m256 two = _mm256_set1_ps(2.0f);
+        __m256 r2 = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+        //f = 1 + k1*r2 + k2*r2*r2 + k3*r2*r2*r2
+        __m256 f = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(one, _mm256_mul_ps(_mm256_set1_ps(c[0]), r2)),
+            _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(c[1]), r2), r2)),
+            _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(c[4]), r2), r2), r2));
+        x = _mm256_mul_ps(x, f);
+        y = _mm256_mul_ps(y, f);
+        //dx = x + 2*p1*x*y + p2*(r2 + 2*x*x), dy = y + 2*p2*x*y + p1*(r2 + 2*y*y)
+        __m256 dx = _mm256_add_ps(_mm256_add_ps(x, _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(two, _mm256_set1_ps(c[2])), x), y)),
+            _mm256_mul_ps(_mm256_set1_ps(c[3]), _mm256_add_ps(r2, _mm256_mul_ps(_mm256_mul_ps(two, x), x))));
+        __m256 dy = _mm256_add_ps(_mm256_add_ps(y, _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(two, _mm256_set1_ps(c[3])), x), y)),
+            _mm256_mul_ps(_mm256_set1_ps(c[2]), _mm256_add_ps(r2, _mm256_mul_ps(_mm256_mul_ps(two, y), y))));
+        x = dx;
+        y = dy;
+    }
+
+    __m256 half = _mm256_set1_ps(0.5f);
+    __m256 colorX = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(intrin.fx)), _mm256_set1_ps(intrin.ppx));
+    __m256 colorY = _mm256_add_ps(_mm256_mul_ps(y, _mm256_set1_ps(intrin.fy)), _mm256_set1_ps(intrin.ppy));
+    pixelX = _mm256_cvttps_epi32(_mm256_add_ps(colorX, half)); //Truncation, same as the (int) cast in rs2::align
+    pixelY = _mm256_cvttps_epi32(_mm256_add_ps(colorY, half));
+}//projectCorners8()
+
+
+
+//Z16 -> meters, ray scale, extrinsic transform and projection for 8 depth pixels per iteration.
+//  The footprints are then written one by one since there is no scatter with a min.
+SIMD_AVX2 inline void DepthAligner::alignRowsAvx2(const uint16_t* depthData, int firstRow, int endRow, uint16_t* aligned, RowSpan& written) const
+{
+    const int width = depthIntrinsics.width;
+    const __m256 scale = _mm256_set1_ps(depthScale);
+    alignas(32) int32_t x0[8], y0[8], x1[8], y1[8];
+
+    for (int y = firstRow; y < endRow; y++)
+    {
+        const uint16_t* depthRow = depthData + y * width;
+        const float* topX = cornerX.data() + (size_t)y * cornerStride;
+        const float* topY = cornerY.data() + (size_t)y * cornerStride;
+        const float* bottomX = topX + cornerStride + 1; //Bottom-right corner of the same pixel
+        const float* bottomY = topY + cornerStride + 1;
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            __m128i raw = _mm_loadu_si128((const __m128i*)(depthRow + x));
+            if (_mm_testz_si128(raw, raw)) //All 8 pixels have no data
+            {
+                continue;
+            }
+            __m256 depth = _mm256_mul_ps(scale, _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(raw)));
+
+            __m256i px, py;
+            projectCorners8(depth2Color, colorIntrinsics, depth, _mm256_loadu_ps(topX + x), _mm256_loadu_ps(topY + x), px, py);
+            _mm256_store_si256((__m256i*)x0, px);
+            _mm256_store_si256((__m256i*)y0, py);
+            projectCorners8(depth2Color, colorIntrinsics, depth, _mm256_loadu_ps(bottomX + x), _mm256_loadu_ps(bottomY + x), px, py);
+            _mm256_store_si256((__m256i*)x1, px);
+            _mm256_store_si256((__m256i*)y1, py);
+
+            for (int lane = 0; lane < 8; lane++) //Scatter with z-buffer min
+            {
+                if (depthRow[x + lane] != 0)
+                {
+                    fillFootprint(depthRow[x + lane], x0[lane], y0[lane], x1[lane], y1[lane], aligned, written);
+                }
+            }
+        }
+        for (; x < width; x++) //Leftover pixels at the end of the row
+        {
+            alignPixel(depthData, x, y, aligned, written);
+        }
+    }
+    _mm256_zeroupper();
+}//alignRowsAvx2()
+#endif
+
+
+
+#ifdef SIMD_SSE2
+//projectCorners8() for 4 points, for CPUs without AVX2
+inline void projectCorners4(const rs2_extrinsics& extrin, const rs2_intrinsics& intrin, __m128 depth, __m128 rayX, __m128 rayY,
+    __m128i& pixelX, __m128i& pixelY)
+{
+    const float* r = extrin.rotation;
+    __m128 px = _mm_mul_ps(depth, rayX);
+    __m128 py = _mm_mul_ps(depth, rayY);
+    __m128 pz = depth;
+
+    __m128 ox = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[0]), px), _mm_mul_ps(_mm_set1_ps(r[3]), py)),
+        _mm_mul_ps(_mm_set1_ps(r[6]), pz)), _mm_set1_ps(extrin.translation[0]));
+    __m128 oy = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[1]), px), _mm_mul_ps(_mm_set1_ps(r[4]), py)),
+        _mm_mul_ps(_mm_set1_ps(r[7]), pz)), _mm_set1_ps(extrin.translation[1]));
+    __m128 oz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[2]), px), _mm_mul_ps(_mm_set1_ps(r[5]), py)),
+        _mm_mul_ps(_mm_set1_ps(r[8]), pz)), _mm_set1_ps(extrin.translation[2]));
+
+    __m128 x = _mm_div_ps(ox, oz);
+    __m128 y = _mm_div_ps(oy, oz);
+
+    if (intrin.model == RS2_DISTORTION_INVERSE_BROWN_CONRADY || intrin.model == RS2_DISTORTION_MODIFIED_BROWN_CONRADY)
+    {
+        const float* c = intrin.coeffs;
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 two = _mm_set1_ps(2.0f);
+        __m128 r2 = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+        //f = 1 + k1*r2 + k2*r2*r2 + k3*r2*r2*r2
+        __m128 f = _mm_add_ps(_mm_add_ps(_mm_add_ps(one, _mm_mul_ps(_mm_set1_ps(c[0]), r2)),
+            _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(c[1]), r2), r2)),
+            _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(c[4]), r2), r2), r2));
+        x = _mm_mul_ps(x, f);
+        y = _mm_mul_ps(y, f);
+        //dx = x + 2*p1*x*y + p2*(r2 + 2*x*x), dy = y + 2*p2*x*y + p1*(r2 + 2*y*y)
+        __m128 dx = _mm_add_ps(_mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(two, _mm_set1_ps(c[2])), x), y)),
+            _mm_mul_ps(_mm_set1_ps(c[3]), _mm_add_ps(r2, _mm_mul_ps(_mm_mul_ps(two, x), x))));
+        __m128 dy = _mm_add_ps(_mm_add_ps(y, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(two, _mm_set1_ps(c[3])), x), y)),
+            _mm_mul_ps(_mm_set1_ps(c[2]), _mm_add_ps(r2, _mm_mul_ps(_mm_mul_ps(two, y), y))));
+        x = dx;
+        y = dy;
+    }
+
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 colorX = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(intrin.fx)), _mm_set1_ps(intrin.ppx));
+    __m128 colorY = _mm_add_ps(_mm_mul_ps(y, _mm_set1_ps(intrin.fy)), _mm_set1_ps(intrin.ppy));
+    pixelX = _mm_cvttps_epi32(_mm_add_ps(colorX, half)); //Truncation, same as the (int) cast in rs2::align
+    pixelY = _mm_cvttps_epi32(_mm_add_ps(colorY, half));
+}//projectCorners4()
+
+
+
+//alignRowsAvx2() 4 depth pixels at a time
+inline void DepthAligner::alignRowsSse2(const uint16_t* depthData, int firstRow, int endRow, uint16_t* aligned, RowSpan& written) const
+{
+    const int width = depthIntrinsics.width;
+    const __m128 scale = _mm_set1_ps(depthScale);
+    const __m128i zero = _mm_setzero_si128();
+    alignas(16) int32_t x0[4], y0[4], x1[4], y1[4];
+
+    for (int y = firstRow; y < endRow; y++)
+    {
+        const uint16_t* depthRow = depthData + y * width;
+        const float* topX = cornerX.data() + (size_t)y * cornerStride;
+        const float* topY = cornerY.data() + (size_t)y * cornerStride;
+        const float* bottomX = topX + cornerStride + 1; //Bottom-right corner of the same pixel
+        const float* bottomY = topY + cornerStride + 1;
+
+        int x = 0;
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i raw = _mm_loadl_epi64((const __m128i*)(depthRow + x));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(raw, zero)) == 0xFFFF) //All 4 pixels have no data (the upper half is zeros)
+            {
+                continue;
+            }
+            __m128 depth = _mm_mul_ps(scale, _mm_cvtepi32_ps(_mm_unpacklo_epi16(raw, zero)));
+
+            __m128i px, py;
+            projectCorners4(depth2Color, colorIntrinsics, depth, _mm_loadu_ps(topX + x), _mm_loadu_ps(topY + x), px, py);
+            _mm_store_si128((__m128i*)x0, px);
+            _mm_store_si128((__m128i*)y0, py);
+            projectCorners4(depth2Color, colorIntrinsics, depth, _mm_loadu_ps(bottomX + x), _mm_loadu_ps(bottomY + x), px, py);
+            _mm_store_si128((__m128i*)x1, px);
+            _mm_store_si128((__m128i*)y1, py);
+
+            for (int lane = 0; lane < 4; lane++) //Scatter with z-buffer min
+            {
+                if (depthRow[x + lane] != 0)
+                {
+                    fillFootprint(depthRow[x + lane], x0[lane], y0[lane], x1[lane], y1[lane], aligned, written);
+                }
+            }
+        }
+        for (; x < width; x++) //Leftover pixels at the end of the row
+        {
+            alignPixel(depthData, x, y, aligned, written);
+        }
+    }
+}//alignRowsSse2()
+#endif
+
+
+
+class SdkAligner
+{
+public:
+    SdkAligner(const rs2_intrinsics& depthIntrin, const rs2_intrinsics& colorIntrin, const rs2_extrinsics& depth2ColorExtrin,
+        float depthUnits, const rs2::frame& colorFrame);
+
+    bool process(const rs2::depth_frame& depth, rs2::depth_frame& aligned); //False if the syncer did not return a pair
+    bool process(const uint16_t* depthData, double timestamp, rs2::depth_frame& aligned); //Same for a copied depth frame
+
+private:
+    rs2::software_device dev;
+    rs2::software_sensor depthSensor;
+    rs2::software_sensor colorSensor;
+    rs2::stream_profile depthStream;
+    rs2::stream_profile colorStream;
+    rs2::syncer sync;
+    rs2::align align;
+    rs2::frame baselineColor;
+    int idx; //A frame number used internally by the syncer
+    int depthWidth;
+};
+
+
+
+//Create software device to allow for merging of old color image frame and current depth frame: Frame Reconstruction
+inline SdkAligner::SdkAligner(const rs2_intrinsics& depthIntrin, const rs2_intrinsics& colorIntrin, const rs2_extrinsics& depth2ColorExtrin,
+    float depthUnits, const rs2::frame& colorFrame)
+    : depthSensor(dev.add_sensor("Depth")), colorSensor(dev.add_sensor("Color")), // New virtual sensors
+      align(RS2_STREAM_COLOR), baselineColor(colorFrame), idx(0), depthWidth(depthIntrin.width)
+{
+    //Add video streams to the virtual sensors so that they can be interacted with
+    depthStream = depthSensor.add_video_stream(
+        { RS2_STREAM_DEPTH, 0, 0, depthIntrin.width, depthIntrin.height, 30, 2, RS2_FORMAT_Z16,
+         depthIntrin });
+    colorStream = colorSensor.add_video_stream(
+        { RS2_STREAM_COLOR, 0, 1, colorIntrin.width, colorIntrin.height, 30, 3, RS2_FORMAT_BGR8,
+         colorIntrin });
+
+    //Set read only option to fix issue of only adding one of the two frames. Note the depth units constant
+    depthSensor.add_read_only_option(RS2_OPTION_DEPTH_UNITS, depthUnits);
+    depthSensor.add_read_only_option(RS2_OPTION_STEREO_BASELINE, 0.001f);
+
+    depthStream.register_extrinsics_to(colorStream, depth2ColorExtrin); // Add camera extrinsics
+
+    // Create the syncer that matches timestamps of both frames
+    dev.create_matcher(RS2_MATCHER_DEFAULT);
+
+    depthSensor.open(depthStream);
+    colorSensor.open(colorStream);
+
+    depthSensor.start(sync);
+    colorSensor.start(sync);
+}//SdkAligner()
+
+
+
+//Injects the depth frame and the baseline color frame into the software device and aligns them
+inline bool SdkAligner::process(const rs2::depth_frame& depth, rs2::depth_frame& aligned)
+{
+    return process((const uint16_t*)depth.get_data(), depth.get_timestamp(), aligned);
+}//process()
+
+
+
+inline bool SdkAligner::process(const uint16_t* depthData, double timestamp, rs2::depth_frame& aligned)
+{
+    rs2::video_frame color = baselineColor.as<rs2::video_frame>();
+
+    colorSensor.on_video_frame({ (void*)color.get_data(), // Frame pixels from baseline color capture
+                                 [](void*) {}, // Custom deleter (if required)
+                                 color.get_stride_in_bytes(), color.get_bytes_per_pixel(), // Stride and Bytes-per-pixel
+                                 timestamp, RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME,
+                                 idx, // Timestamp, Frame# for potential sync services
+                                 colorStream });
+    depthSensor.on_video_frame({ (void*)depthData, // Frame pixels from capture API
+                                 [](void*) {}, // Custom deleter (if required)
+                                 depthWidth * 2, 2, // Stride and Bytes-per-pixel (Z16)
+                                 timestamp, RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME,
+                                 idx, // Timestamp, Frame# for potential sync services
+                                 depthStream });
+    idx++;
+
+    rs2::frameset fsAligned = sync.wait_for_frames();
+    if (fsAligned.size() != 2) //If both a color and depth frame are not ready
+    {
+        return false;
+    }
+
+    fsAligned = align.process(fsAligned); //Align the depth to the color frame
+    aligned = fsAligned.get_depth_frame(); //Get the aligned depth frame
+    return true;
+}//process()
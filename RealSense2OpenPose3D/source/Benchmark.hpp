@@ -0,0 +1,357 @@
+//Keypoint file benchmark for RealSense to OpenPose 3D
+//
+//benchmark=true times the work done on every keypoint file without a camera: synthetic OpenPose files with 1, 5, and
+//  20 people (body, face, and both hands, 137 keypoints each) are read many times over with the full nlohmann DOM and
+//  per-keypoint lookups the program used to do, with nlohmann's SAX parser, and with the OpenPose-specific reader
+//  registration uses (see KeypointReader.hpp). Each sums every value it reads, so they can be checked against each
+//  other and none can be optimized away. The same files, with 3D keypoints added like fusion does, are then written
+//  with nlohmann's dump(4) and with KeypointWriter (see KeypointWriter.hpp), comparing both time and size. Last,
+//  adding the 3D keypoints to a file by parsing, adding, and writing it is timed against splicing them into its text
+//  and against packing them into a binary file (see BinaryKeypoints.hpp). Finally 4 cameras around a room each see the
+//  same 15 people, and world fusion (see WorldFusion.hpp) is timed merging their views into world frames.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "./json.hpp"
+#include "./BinaryKeypoints.hpp"
+#include "./KeypointReader.hpp"
+#include "./KeypointWriter.hpp"
+#include "./WorldFusion.hpp"
+#include "./Stats.hpp" //elapsedMs()
+
+
+//An OpenPose keypoint file with people people, written the way OpenPose writes it (one line, 6 significant digits,
+//  empty 3D arrays). About 1 in 10 keypoints is missing (all zeros).
+inline std::string makeKeypointFile(int people, unsigned seed = 1)
+{
+    static const int partKeypoints[KEYPOINT_PART_COUNT] = { 25, 70, 21, 21 };
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> x(0.0f, 1920.0f);
+    std::uniform_real_distribution<float> y(0.0f, 1080.0f);
+    std::uniform_real_distribution<float> confidence(0.05f, 1.0f);
+
+    std::string text = "{\"version\":1.3,\"people\":[";
+    char number[64];
+    for (int i = 0; i < people; i++)
+    {
+        text += i == 0 ? "{\"person_id\":[-1]" : ",\n{\"person_id\":[-1]";
+        for (int part = 0; part < KEYPOINT_PART_COUNT; part++)
+        {
+            text += ",\"" + std::string(keypointParts[part]) + "_keypoints_2d\":[";
+            for (int j = 0; j < partKeypoints[part]; j++)
+            {
+                bool missing = random() % 10 == 0;
+                std::snprintf(number, sizeof(number), "%s%.6g,%.6g,%.6g", j == 0 ? "" : ",", missing ? 0.0f : x(random), missing ? 0.0f : y(random),
+                    missing ? 0.0f : confidence(random));
+                text += number;
+            }
+            text += "]";
+        }
+        for (int part = 0; part < KEYPOINT_PART_COUNT; part++)
+        {
+            text += ",\"" + std::string(keypointParts[part]) + "_keypoints_3d\":[]";
+        }
+        text += "}";
+    }
+    text += "]}\n";
+    return text;
+}//makeKeypointFile()
+
+
+
+//What registration used to do: the whole file as a DOM, then each part found by name and read value by value
+inline double sumKeypointsDom(const std::string& text)
+{
+    double sum = 0;
+    nlohmann::json document = nlohmann::json::parse(text);
+    for (nlohmann::json& person : document["people"])
+    {
+        for (const char* part : keypointParts)
+        {
+            auto keypoints2d = person.find(std::string(part) + "_keypoints_2d");
+            if (keypoints2d == person.end())
+            {
+                continue;
+            }
+            for (size_t j = 0; j + 2 < keypoints2d->size(); j += 3)
+            {
+                sum += (*keypoints2d)[j].get<double>() + (*keypoints2d)[j + 1].get<double>() + (*keypoints2d)[j + 2].get<double>();
+            }
+        }
+    }
+    return sum;
+}//sumKeypointsDom()
+
+
+
+inline double sumKeypoints(const KeypointFile& file)
+{
+    double sum = 0;
+    for (size_t i = 0; i < file.people(); i++)
+    {
+        for (int part = 0; part < KEYPOINT_PART_COUNT; part++)
+        {
+            const double* values = file.part(i, part);
+            for (size_t j = 0; j + 2 < file.partValues(i, part); j += 3)
+            {
+                sum += values[j] + values[j + 1] + values[j + 2];
+            }
+        }
+    }
+    return sum;
+}//sumKeypoints()
+
+
+
+//The file made by makeKeypointFile() with every person's *_keypoints_3d arrays filled in, as fusion leaves it
+inline nlohmann::json makeFusedDocument(int people, unsigned seed = 1)
+{
+    nlohmann::json document = nlohmann::json::parse(makeKeypointFile(people, seed));
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> meters(-2.0f, 2.0f);
+    for (nlohmann::json& person : document["people"])
+    {
+        for (const char* part : keypointParts)
+        {
+            const nlohmann::json& keypoints2d = person[std::string(part) + "_keypoints_2d"];
+            std::vector<double> keypoints3d(keypoints2d.size() / 3 * 4, 0.0);
+            for (size_t j = 0; j < keypoints2d.size() / 3; j++)
+            {
+                if (keypoints2d[3 * j + 2].get<double>() > 0)
+                {
+                    keypoints3d[4 * j] = meters(random);
+                    keypoints3d[4 * j + 1] = meters(random);
+                    keypoints3d[4 * j + 2] = meters(random) + 3.0f;
+                    keypoints3d[4 * j + 3] = keypoints2d[3 * j + 2].get<double>();
+                }
+            }
+            person[std::string(part) + "_keypoints_3d"] = keypoints3d;
+        }
+    }
+    return document;
+}//makeFusedDocument()
+
+
+
+//cameras views of people standing on a grid, each camera 5 m from the middle of the room looking at it. poses gets each
+//  camera's pose, views its keypoint file (pose_keypoints_3d only, a few millimeters of noise on each camera), and truth
+//  every person's joints in the world.
+inline void makeWorldViews(int people, int cameras, std::vector<rs2_extrinsics>& poses, std::vector<nlohmann::json>& views,
+    std::vector<std::vector<float>>& truth, unsigned seed = 1)
+{
+    const int joints = 25;
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> offset(-0.3f, 0.3f);
+    std::uniform_real_distribution<float> noise(-0.005f, 0.005f);
+
+    truth.assign(people, std::vector<float>(3 * joints));
+    for (int i = 0; i < people; i++)
+    {
+        for (int j = 0; j < joints; j++)
+        {
+            truth[i][3 * j] = (float)(i % 5) - 2.0f + offset(random);
+            truth[i][3 * j + 1] = offset(random) * 3.0f; //Head to feet
+            truth[i][3 * j + 2] = (float)(i / 5) - 1.0f + offset(random);
+        }
+    }
+
+    poses.assign(cameras, rs2_extrinsics());
+    views.assign(cameras, nlohmann::json());
+    for (int c = 0; c < cameras; c++)
+    {
+        //Turned about the y axis to face the middle from around the room, column-major like rs2_extrinsics
+        float angle = 6.2831853f * c / cameras;
+        float cosine = std::cos(angle), sine = std::sin(angle);
+        float rotation[9] = { cosine, 0, -sine, 0, 1, 0, sine, 0, cosine };
+        std::copy(rotation, rotation + 9, poses[c].rotation);
+        poses[c].translation[0] = -5.0f * sine;
+        poses[c].translation[1] = 0;
+        poses[c].translation[2] = -5.0f * cosine;
+
+        views[c]["people"] = nlohmann::json::array();
+        for (int i = 0; i < people; i++)
+        {
+            std::vector<float> keypoints3d(4 * joints);
+            for (int j = 0; j < joints; j++)
+            {
+                //World to camera: the transpose of the rotation applied after taking the translation away
+                float relative[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    relative[k] = truth[i][3 * j + k] - poses[c].translation[k];
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    keypoints3d[4 * j + k] = rotation[3 * k] * relative[0] + rotation[3 * k + 1] * relative[1] + rotation[3 * k + 2] * relative[2] + noise(random);
+                }
+                keypoints3d[4 * j + 3] = 0.8f;
+            }
+            nlohmann::json person;
+            person["pose_keypoints_3d"] = keypoints3d;
+            views[c]["people"].push_back(std::move(person));
+        }
+    }
+}//makeWorldViews()
+
+
+
+//The largest distance, in meters, from a fused person to the closest true one, averaged over their joints
+inline float worldFusionError(const nlohmann::json& fused, const std::vector<std::vector<float>>& truth)
+{
+    float worst = 0;
+    for (const nlohmann::json& person : fused["people"])
+    {
+        std::vector<float> joints = person["pose_keypoints_3d"].get<std::vector<float>>();
+        float closest = std::numeric_limits<float>::infinity();
+        for (const std::vector<float>& truePerson : truth)
+        {
+            float total = 0;
+            for (size_t j = 0; j < truePerson.size() / 3; j++)
+            {
+                float dx = joints[4 * j] - truePerson[3 * j];
+                float dy = joints[4 * j + 1] - truePerson[3 * j + 1];
+                float dz = joints[4 * j + 2] - truePerson[3 * j + 2];
+                total += std::sqrt(dx * dx + dy * dy + dz * dz);
+            }
+            closest = std::min(closest, total / (truePerson.size() / 3));
+        }
+        worst = std::max(worst, closest);
+    }
+    return worst;
+}//worldFusionError()
+
+
+
+//Mean microseconds per call of run(), which returns the sum of the values it read (if any), and that sum
+template <class Run>
+inline double timeRuns(int iterations, Run run, double& sum)
+{
+    sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        sum += run();
+    }
+    return elapsedMs(start, std::chrono::steady_clock::now()) * 1000.0 / iterations;
+}//timeRuns()
+
+
+
+//Prints the mean time per file of each way of reading it
+inline void runKeypointBenchmark(int iterations = 2000)
+{
+    std::cout << "Reading keypoint files, mean of " << iterations << " runs:\n";
+    KeypointFile file; //Reused like the pipeline's jobs do
+    std::string error;
+    int errorId;
+    for (int people : { 1, 5, 20 })
+    {
+        std::string text = makeKeypointFile(people);
+
+        double domSum, saxSum, schemaSum;
+        double domUs = timeRuns(iterations, [&]() { return sumKeypointsDom(text); }, domSum);
+        double saxUs = timeRuns(iterations, [&]() { readKeypointsSax(text, file, error, errorId); return sumKeypoints(file); }, saxSum);
+        double schemaUs = timeRuns(iterations, [&]() { readKeypoints(text.data(), text.size(), file, error); return sumKeypoints(file); }, schemaSum);
+
+        std::cout << "  " << people << (people == 1 ? " person (" : " people (") << text.size() / 1024 << " KB): DOM " << domUs << " us, SAX "
+            << saxUs << " us (" << domUs / saxUs << "x), OpenPose reader " << schemaUs << " us (" << domUs / schemaUs << "x)"
+            << (domSum == saxSum && domSum == schemaSum ? "" : ", THE VALUES DIFFER") << "\n";
+    }
+
+    std::cout << "Writing keypoint files with 3D keypoints, mean of " << iterations << " runs:\n";
+    std::string text; //Reused like the pipeline's jobs do
+    for (int people : { 1, 5, 20 })
+    {
+        nlohmann::json document = makeFusedDocument(people);
+        double unused;
+
+        size_t dumpBytes = 0;
+        double dumpUs = timeRuns(iterations, [&]() { text = document.dump(4); text += '\n'; dumpBytes = text.size(); return 0.0; }, unused);
+        size_t compactBytes = 0;
+        double compactUs = timeRuns(iterations, [&]() { KeypointWriter().write(document, text); compactBytes = text.size(); return 0.0; }, unused);
+        size_t millimetreBytes = 0;
+        double millimetreUs = timeRuns(iterations, [&]() { KeypointWriter(3).write(document, text); millimetreBytes = text.size(); return 0.0; }, unused);
+
+        std::cout << "  " << people << (people == 1 ? " person: " : " people: ") << "dump(4) " << dumpUs << " us " << dumpBytes / 1024 << " KB, compact "
+            << compactUs << " us " << compactBytes / 1024 << " KB, precision=3 " << millimetreUs << " us " << millimetreBytes / 1024 << " KB\n";
+    }
+
+    std::cout << "Adding 3D keypoints to a file, mean of " << iterations << " runs:\n";
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> meters(-2.0f, 2.0f);
+    for (int people : { 1, 5, 20 })
+    {
+        std::string source = makeKeypointFile(people);
+        readKeypoints(source.data(), source.size(), file, error);
+        std::vector<float> points;
+        for (size_t i = 0; i < file.people(); i++)
+        {
+            for (int part = 0; part < KEYPOINT_PART_COUNT; part++)
+            {
+                for (size_t j = 0; j < file.partValues(i, part) / 3; j++)
+                {
+                    points.insert(points.end(), { meters(random), meters(random), meters(random) + 3.0f, (float)file.part(i, part)[3 * j + 2] });
+                }
+            }
+        }
+        double unused;
+
+        double domUs = timeRuns(iterations, [&]() {
+            nlohmann::json document = nlohmann::json::parse(source);
+            const float* point = points.data();
+            for (size_t i = 0; i < file.people(); i++)
+            {
+                for (int part = 0; part < KEYPOINT_PART_COUNT; part++)
+                {
+                    size_t count = 4 * (file.partValues(i, part) / 3);
+                    document["people"][i][std::string(keypointParts[part]) + "_keypoints_3d"] = std::vector<float>(point, point + count);
+                    point += count;
+                }
+            }
+            KeypointWriter().write(document, text);
+            return 0.0;
+        }, unused);
+        size_t spliceBytes = 0;
+        double spliceUs = timeRuns(iterations, [&]() { KeypointWriter().splice(source, file, points, text); spliceBytes = text.size(); return 0.0; }, unused);
+        std::string binary;
+        double binaryUs = timeRuns(iterations, [&]() { encodeBinaryKeypoints(file, points, 1, 0, binary); return 0.0; }, unused);
+
+        std::cout << "  " << people << (people == 1 ? " person: " : " people: ") << "parse, add, and write " << domUs << " us, splice " << spliceUs << " us ("
+            << domUs / spliceUs << "x) " << spliceBytes / 1024 << " KB, binary " << binaryUs << " us (" << domUs / binaryUs << "x) " << binary.size() / 1024
+            << " KB\n";
+    }
+
+    std::cout << "Fusing 4 cameras' views of 15 people into world frames, mean of " << iterations << " frames:\n";
+    {
+        std::vector<rs2_extrinsics> poses;
+        std::vector<nlohmann::json> views;
+        std::vector<std::vector<float>> truth;
+        makeWorldViews(15, 4, poses, views, truth);
+        WorldFusion fusion(poses);
+        nlohmann::json fused;
+        int frame = 0;
+        double unused;
+        double frameUs = timeRuns(iterations, [&]() {
+            double timeMs = 33.3 * frame++; //30 FPS, all 4 cameras at once
+            for (int c = (int)views.size() - 1; c >= 0; c--) //The reference camera last, so it sees the others
+            {
+                fusion.addView(c, timeMs, views[c], fused);
+            }
+            return 0.0;
+        }, unused);
+
+        std::cout << "  " << frameUs / views.size() << " us per view, " << frameUs << " us per world frame (" << 30 * frameUs / 1000.0
+            << " ms of every second at 30 FPS), " << fused["people"].size() << " of " << truth.size() << " people found, worst "
+            << 1000 * worldFusionError(fused, truth) << " mm off\n";
+    }
+}//runKeypointBenchmark()
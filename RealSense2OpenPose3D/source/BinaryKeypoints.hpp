@@ -0,0 +1,213 @@
+//Binary keypoint files for RealSense to OpenPose 3D
+//
+//With output=binary (or both) each frame's 3D keypoints are also written as ############_keypointsD.bin, so viewers
+//  and analysis code can load a frame with one read instead of parsing JSON. Everything is little-endian:
+//    byte  0  char[4]    magic "RS3D"
+//          4  uint16     version (1)
+//          6  uint16     part count (4: pose, face, hand_left, hand_right, as in keypointParts)
+//          8  uint64     frame id (OpenPose's frame number, as in the file name)
+//         16  float64    timestamp, milliseconds since 1970 (estimated time the color image was taken)
+//         24  uint32     people
+//         28  uint32     keypoints per person (the sum of the next four)
+//         32  uint32[4]  keypoints of each part
+//         48  float32[people][keypoints per person][4]: x, y, z in meters (color camera coordinates), confidence
+//  Every person has the same parts at the same places, so the records are one fixed-size array. A part a person doesn't
+//  have (a hand OpenPose didn't find) is all zeros, the same as a keypoint without depth. readBinaryKeypoints() reads a
+//  file back in C++, BinaryKeypoints.py does the same in Python with numpy.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "./KeypointReader.hpp" //KeypointFile
+
+
+const char BINARY_KEYPOINTS_MAGIC[4] = { 'R', 'S', '3', 'D' };
+const uint16_t BINARY_KEYPOINTS_VERSION = 1;
+const size_t BINARY_KEYPOINTS_HEADER_BYTES = 48;
+
+
+//One binary keypoint file
+struct BinaryKeypointFrame
+{
+    uint64_t frameId = 0;
+    double timestampMs = 0;
+    uint32_t people = 0;
+    uint32_t keypointsPerPerson = 0;
+    uint32_t partKeypoints[KEYPOINT_PART_COUNT] = {};
+    std::vector<float> points; //people * keypointsPerPerson * (x, y, z, confidence)
+
+    const float* person(size_t index) const { return points.data() + index * keypointsPerPerson * 4; }
+
+    //First keypoint of a part within each person
+    uint32_t partStart(int part) const
+    {
+        uint32_t start = 0;
+        for (int i = 0; i < part; i++)
+        {
+            start += partKeypoints[i];
+        }
+        return start;
+    }
+};
+
+
+
+inline bool hostIsLittleEndian()
+{
+    const uint16_t one = 1;
+    unsigned char first;
+    std::memcpy(&first, &one, 1);
+    return first == 1;
+}//hostIsLittleEndian()
+
+
+
+//Little-endian fields, byte by byte so it doesn't matter what the host is
+inline void putLittleEndian(char* bytes, uint64_t value, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        bytes[i] = (char)((value >> (8 * i)) & 0xFF);
+    }
+}//putLittleEndian()
+
+
+
+inline uint64_t getLittleEndian(const char* bytes, int size)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < size; i++)
+    {
+        value |= (uint64_t)(unsigned char)bytes[i] << (8 * i);
+    }
+    return value;
+}//getLittleEndian()
+
+
+
+//Replaces bytes with a binary keypoint file of points, fusion's x, y, z, confidence of every keypoint of every part
+//  file has (see fusePerson()). Each part is as long as the longest one in the file.
+inline void encodeBinaryKeypoints(const KeypointFile& file, const std::vector<float>& points, uint64_t frameId, double timestampMs, std::string& bytes)
+{
+    uint32_t partKeypoints[KEYPOINT_PART_COUNT] = {};
+    uint32_t keypointsPerPerson = 0;
+    for (int part = 0; part < KEYPOINT_PART_COUNT; part++)
+    {
+        for (size_t i = 0; i < file.people(); i++)
+        {
+            partKeypoints[part] = std::max(partKeypoints[part], (uint32_t)(file.partValues(i, part) / 3));
+        }
+        keypointsPerPerson += partKeypoints[part];
+    }
+
+    char header[BINARY_KEYPOINTS_HEADER_BYTES];
+    std::memcpy(header, BINARY_KEYPOINTS_MAGIC, 4);
+    putLittleEndian(header + 4, BINARY_KEYPOINTS_VERSION, 2);
+    putLittleEndian(header + 6, KEYPOINT_PART_COUNT, 2);
+    putLittleEndian(header + 8, frameId, 8);
+    uint64_t timestampBits;
+    std::memcpy(&timestampBits, &timestampMs, 8);
+    putLittleEndian(header + 16, timestampBits, 8);
+    putLittleEndian(header + 24, (uint32_t)file.people(), 4);
+    putLittleEndian(header + 28, keypointsPerPerson, 4);
+    for (int part = 0; part < KEYPOINT_PART_COUNT; part++)
+    {
+        putLittleEndian(header + 32 + 4 * part, partKeypoints[part], 4);
+    }
+
+    //Records, zeros wherever a person's part is shorter than the layout
+    size_t recordBytes = file.people() * keypointsPerPerson * 4 * sizeof(float);
+    bytes.assign(header, BINARY_KEYPOINTS_HEADER_BYTES);
+    bytes.resize(BINARY_KEYPOINTS_HEADER_BYTES + recordBytes, '\0');
+    char* record = &bytes[0] + BINARY_KEYPOINTS_HEADER_BYTES;
+    bool littleEndian = hostIsLittleEndian();
+    size_t keypoint = 0; //In points
+    for (size_t i = 0; i < file.people(); i++)
+    {
+        for (int part = 0; part < KEYPOINT_PART_COUNT; part++)
+        {
+            size_t count = file.partValues(i, part) / 3;
+            const float* source = points.data() + 4 * keypoint;
+            if (littleEndian)
+            {
+                std::memcpy(record, source, count * 4 * sizeof(float));
+            }
+            else
+            {
+                for (size_t j = 0; j < 4 * count; j++)
+                {
+                    uint32_t bits;
+                    std::memcpy(&bits, &source[j], 4);
+                    putLittleEndian(record + 4 * j, bits, 4);
+                }
+            }
+            keypoint += count;
+            record += partKeypoints[part] * 4 * sizeof(float);
+        }
+    }
+}//encodeBinaryKeypoints()
+
+
+
+//Reads a file written by encodeBinaryKeypoints(). Returns false, saying why in error, if it isn't one.
+inline bool readBinaryKeypoints(const std::string& path, BinaryKeypointFrame& frame, std::string& error)
+{
+    std::ifstream file(path, std::ios::binary);
+    char header[BINARY_KEYPOINTS_HEADER_BYTES];
+    if (!file.read(header, BINARY_KEYPOINTS_HEADER_BYTES))
+    {
+        error = "could not read the header of \"" + path + "\"";
+        return false;
+    }
+    if (std::memcmp(header, BINARY_KEYPOINTS_MAGIC, 4) != 0)
+    {
+        error = "\"" + path + "\" is not a binary keypoint file";
+        return false;
+    }
+    if (getLittleEndian(header + 4, 2) != BINARY_KEYPOINTS_VERSION || getLittleEndian(header + 6, 2) != KEYPOINT_PART_COUNT)
+    {
+        error = "\"" + path + "\" is version " + std::to_string(getLittleEndian(header + 4, 2)) + " with " + std::to_string(getLittleEndian(header + 6, 2))
+            + " parts, this reader only knows version 1 with 4";
+        return false;
+    }
+
+    frame.frameId = getLittleEndian(header + 8, 8);
+    uint64_t timestampBits = getLittleEndian(header + 16, 8);
+    std::memcpy(&frame.timestampMs, &timestampBits, 8);
+    frame.people = (uint32_t)getLittleEndian(header + 24, 4);
+    frame.keypointsPerPerson = (uint32_t)getLittleEndian(header + 28, 4);
+    uint32_t layoutKeypoints = 0;
+    for (int part = 0; part < KEYPOINT_PART_COUNT; part++)
+    {
+        frame.partKeypoints[part] = (uint32_t)getLittleEndian(header + 32 + 4 * part, 4);
+        layoutKeypoints += frame.partKeypoints[part];
+    }
+    if (layoutKeypoints != frame.keypointsPerPerson)
+    {
+        error = "the part layout of \"" + path + "\" doesn't add up";
+        return false;
+    }
+
+    size_t values = (size_t)frame.people * frame.keypointsPerPerson * 4;
+    frame.points.resize(values);
+    if (values > 0 && !file.read((char*)frame.points.data(), (std::streamsize)(values * sizeof(float))))
+    {
+        error = "\"" + path + "\" is shorter than its header says";
+        return false;
+    }
+    if (!hostIsLittleEndian())
+    {
+        for (float& value : frame.points)
+        {
+            uint32_t bits = (uint32_t)getLittleEndian((const char*)&value, 4);
+            std::memcpy(&value, &bits, 4);
+        }
+    }
+    return true;
+}//readBinaryKeypoints()
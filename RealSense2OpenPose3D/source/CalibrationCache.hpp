@@ -0,0 +1,192 @@
+//Calibration cache for RealSense to OpenPose 3D
+//
+//Sparse and full registration only need the camera values (intrinsics, depth to color extrinsics, and depth scale), not
+//  any color pixels. queryCalibration() reads them from the device's stream profiles without starting a stream, and
+//  they are saved as a small JSON file named after the device's serial number and both resolutions. Later launches
+//  load that file instead, as long as the firmware version it was saved with still matches (a firmware update may
+//  come with a new calibration). Only when neither works does the program fall back to the warm-up capture.
+
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <librealsense2/rs.hpp>
+
+#include "./json.hpp"
+#include "./Paths.hpp"
+
+
+struct CameraCalibration
+{
+    rs2_intrinsics colorIntrinsics;
+    rs2_intrinsics depthIntrinsics;
+    rs2_extrinsics depth2ColorExtrinsics;
+    float depthScale; //Meters per depth unit
+};
+
+
+
+//Cache file for one device at one pair of resolutions
+inline std::string calibrationCachePath(const std::string& directory, const std::string& serial, int depthWidth, int depthHeight, int colorWidth, int colorHeight)
+{
+    char resolutions[64];
+    std::snprintf(resolutions, sizeof(resolutions), "_%dx%d_%dx%d", depthWidth, depthHeight, colorWidth, colorHeight);
+    return joinPath(directory, "calibration_" + serial + resolutions + ".json");
+}//calibrationCachePath()
+
+
+
+inline nlohmann::json intrinsicsToJson(const rs2_intrinsics& intrinsics)
+{
+    nlohmann::json values;
+    values["width"] = intrinsics.width;
+    values["height"] = intrinsics.height;
+    values["ppx"] = intrinsics.ppx;
+    values["ppy"] = intrinsics.ppy;
+    values["fx"] = intrinsics.fx;
+    values["fy"] = intrinsics.fy;
+    values["model"] = (int)intrinsics.model;
+    values["coeffs"] = std::vector<float>(intrinsics.coeffs, intrinsics.coeffs + 5);
+    return values;
+}//intrinsicsToJson()
+
+
+
+inline rs2_intrinsics intrinsicsFromJson(const nlohmann::json& values)
+{
+    rs2_intrinsics intrinsics;
+    intrinsics.width = values.at("width").get<int>();
+    intrinsics.height = values.at("height").get<int>();
+    intrinsics.ppx = values.at("ppx").get<float>();
+    intrinsics.ppy = values.at("ppy").get<float>();
+    intrinsics.fx = values.at("fx").get<float>();
+    intrinsics.fy = values.at("fy").get<float>();
+    intrinsics.model = (rs2_distortion)values.at("model").get<int>();
+    for (int i = 0; i < 5; i++)
+    {
+        intrinsics.coeffs[i] = values.at("coeffs").at(i).get<float>();
+    }
+    return intrinsics;
+}//intrinsicsFromJson()
+
+
+
+//False if there is no cache file, it can't be read, or it was saved for other firmware or resolutions (stale)
+inline bool loadCalibration(const std::string& path, const std::string& firmware, int depthWidth, int depthHeight, int colorWidth, int colorHeight,
+    CameraCalibration& calibration)
+{
+    std::ifstream file(path);
+    if (!file.good())
+    {
+        return false;
+    }
+
+    try
+    {
+        nlohmann::json values = nlohmann::json::parse(file);
+        if (values.at("firmware").get<std::string>() != firmware)
+        {
+            std::cout << "The cached calibration is from firmware " << values.at("firmware").get<std::string>() << ", this camera has " << firmware << ".\n";
+            return false;
+        }
+        calibration.depthIntrinsics = intrinsicsFromJson(values.at("depth"));
+        calibration.colorIntrinsics = intrinsicsFromJson(values.at("color"));
+        for (int i = 0; i < 9; i++)
+        {
+            calibration.depth2ColorExtrinsics.rotation[i] = values.at("depth_to_color").at("rotation").at(i).get<float>();
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            calibration.depth2ColorExtrinsics.translation[i] = values.at("depth_to_color").at("translation").at(i).get<float>();
+        }
+        calibration.depthScale = values.at("depth_scale").get<float>();
+    }
+    catch (const nlohmann::json::exception& e)
+    {
+        std::cout << "The cached calibration \"" << path << "\" could not be read: " << e.what() << "\n";
+        return false;
+    }
+
+    return calibration.depthIntrinsics.width == depthWidth && calibration.depthIntrinsics.height == depthHeight
+        && calibration.colorIntrinsics.width == colorWidth && calibration.colorIntrinsics.height == colorHeight;
+}//loadCalibration()
+
+
+
+inline void saveCalibration(const std::string& path, const std::string& firmware, const CameraCalibration& calibration)
+{
+    nlohmann::json values;
+    values["firmware"] = firmware;
+    values["depth"] = intrinsicsToJson(calibration.depthIntrinsics);
+    values["color"] = intrinsicsToJson(calibration.colorIntrinsics);
+    values["depth_to_color"]["rotation"] = std::vector<float>(calibration.depth2ColorExtrinsics.rotation, calibration.depth2ColorExtrinsics.rotation + 9);
+    values["depth_to_color"]["translation"] = std::vector<float>(calibration.depth2ColorExtrinsics.translation, calibration.depth2ColorExtrinsics.translation + 3);
+    values["depth_scale"] = calibration.depthScale;
+
+    std::ofstream file(path);
+    if (!file.good())
+    {
+        std::cout << "Could not save the calibration to \"" << path << "\".\n";
+        return;
+    }
+    file << std::setw(4) << values << std::endl;
+}//saveCalibration()
+
+
+
+//Reads the camera values from the device's Z16 depth and BGR8 color profiles at the given resolutions and frame rate
+//  without streaming. False if the device doesn't offer both.
+inline bool queryCalibration(const rs2::device& device, int depthWidth, int depthHeight, int colorWidth, int colorHeight, int fps,
+    CameraCalibration& calibration)
+{
+    try
+    {
+        rs2::video_stream_profile depthProfile;
+        rs2::video_stream_profile colorProfile;
+        bool foundDepth = false;
+        bool foundColor = false;
+        for (const rs2::sensor& sensor : device.query_sensors())
+        {
+            for (const rs2::stream_profile& profile : sensor.get_stream_profiles())
+            {
+                if (!profile.is<rs2::video_stream_profile>() || profile.fps() != fps)
+                {
+                    continue;
+                }
+                rs2::video_stream_profile video = profile.as<rs2::video_stream_profile>();
+                if (!foundDepth && video.stream_type() == RS2_STREAM_DEPTH && video.format() == RS2_FORMAT_Z16
+                    && video.width() == depthWidth && video.height() == depthHeight)
+                {
+                    depthProfile = video;
+                    foundDepth = true;
+                }
+                else if (!foundColor && video.stream_type() == RS2_STREAM_COLOR && video.format() == RS2_FORMAT_BGR8
+                    && video.width() == colorWidth && video.height() == colorHeight)
+                {
+                    colorProfile = video;
+                    foundColor = true;
+                }
+            }
+        }
+        if (!foundDepth || !foundColor)
+        {
+            return false;
+        }
+
+        calibration.depthIntrinsics = depthProfile.get_intrinsics();
+        calibration.colorIntrinsics = colorProfile.get_intrinsics();
+        calibration.depth2ColorExtrinsics = depthProfile.get_extrinsics_to(colorProfile);
+        calibration.depthScale = device.first<rs2::depth_sensor>().get_depth_scale();
+    }
+    catch (const rs2::error& e)
+    {
+        std::cout << "Could not read the camera values from the device: " << e.what() << "\n";
+        return false;
+    }
+    return true;
+}//queryCalibration()
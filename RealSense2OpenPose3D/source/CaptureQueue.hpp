@@ -0,0 +1,167 @@
+//Capture to fusion hand-off for RealSense to OpenPose 3D
+//
+//The capture thread only waits for depth frames and copies them into pooled DepthSlots, so a slow disk or a long
+//  alignment on the fusion side never makes it miss camera frames. Slots travel between the threads by index through
+//  two SpscQueues: filled (capture -> fusion) and free (fusion -> capture, once fusion is done with a slot). The pool
+//  is allocated once, big enough for the queue, the fusion side's history, and the slot being written.
+//
+//The filled queue holds at most queue= frames. When fusion falls so far behind that it is full, or that there are no
+//  free slots, the drop policy decides what happens:
+//  DROP_OLDEST: capture takes back the oldest frame fusion has not picked up yet and reuses it, so fusion always
+//      gets the newest frames
+//  BLOCK: capture waits for fusion to pick up a frame or free a slot. Nothing queued is lost, but librealsense drops
+//      frames meanwhile
+//Both sides keep counters so it is clear which stage is the bottleneck.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <librealsense2/rs.hpp>
+
+#include "./DepthRingBuffer.hpp" //DepthSlot
+#include "./SpscQueue.hpp"
+
+
+enum DropPolicy
+{
+    DROP_OLDEST,
+    BLOCK
+};
+
+
+
+class CaptureQueue
+{
+public:
+    CaptureQueue(int queueFrames, int historyFrames, int depthWidth, int depthHeight, DropPolicy dropPolicy);
+
+    //Capture thread
+    bool push(const rs2::depth_frame& depth, std::chrono::system_clock::time_point arrival); //False if the frame was dropped
+    void stop() { stopping.store(true); } //Releases a blocked push()
+
+    //Fusion thread
+    DepthSlot* pop(); //Next captured frame, nullptr if there is none yet
+    void release(DepthSlot* slot); //Hands a slot back once fusion is done with it
+
+    size_t memoryBytes() const;
+    void printCounters() const;
+
+private:
+    DropPolicy policy;
+    std::vector<DepthSlot> pool;
+    SpscQueue<int> filledSlots; //Slots with frames fusion has not picked up
+    SpscQueue<int> freeSlots; //Slots capture may write to
+    std::atomic<bool> stopping;
+
+    //Capture side counters
+    std::atomic<unsigned long long> framesCaptured;
+    std::atomic<unsigned long long> framesDropped; //Replaced before fusion saw them (DROP_OLDEST)
+    std::atomic<unsigned long long> blockedMicroseconds; //Time spent waiting for a free slot (BLOCK)
+    std::atomic<int> mostQueued;
+
+    //Fusion side counters
+    std::atomic<unsigned long long> framesFused;
+};
+
+
+
+inline CaptureQueue::CaptureQueue(int queueFrames, int historyFrames, int depthWidth, int depthHeight, DropPolicy dropPolicy)
+    : policy(dropPolicy), pool(std::max(1, queueFrames) + std::max(1, historyFrames) + 1),
+      filledSlots(std::max(1, queueFrames)), freeSlots((int)pool.size()), stopping(false),
+      framesCaptured(0), framesDropped(0), blockedMicroseconds(0), mostQueued(0), framesFused(0)
+{
+    for (int i = 0; i < (int)pool.size(); i++)
+    {
+        pool[i].allocate(depthWidth, depthHeight);
+        freeSlots.push(i);
+    }
+}//CaptureQueue()
+
+
+
+inline bool CaptureQueue::push(const rs2::depth_frame& depth, std::chrono::system_clock::time_point arrival)
+{
+    //Only this thread pushes to filledSlots, so a queue that isn't full can't fill up before the push below
+    int slot;
+    if (filledSlots.count() >= filledSlots.capacity() || !freeSlots.pop(slot)) //The queue is full or fusion is holding every other slot
+    {
+        if (policy == DROP_OLDEST)
+        {
+            if (filledSlots.pop(slot))
+            {
+                framesDropped++;
+            }
+            else if (!freeSlots.pop(slot)) //Fusion just took the last queued frame, and still holds every other slot
+            {
+                framesDropped++;
+                return false;
+            }
+        }
+        else
+        {
+            auto blockStart = std::chrono::steady_clock::now();
+            while (filledSlots.count() >= filledSlots.capacity() || !freeSlots.pop(slot))
+            {
+                if (stopping.load())
+                {
+                    return false;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            blockedMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - blockStart).count();
+        }
+    }
+
+    pool[slot].copyFrom(depth, arrival);
+    filledSlots.push(slot); //Never full, there was room or a frame was taken out above
+    framesCaptured++;
+
+    int queued = filledSlots.count();
+    if (queued > mostQueued.load(std::memory_order_relaxed))
+    {
+        mostQueued.store(queued, std::memory_order_relaxed);
+    }
+    return true;
+}//push()
+
+
+
+inline DepthSlot* CaptureQueue::pop()
+{
+    int slot;
+    if (!filledSlots.pop(slot))
+    {
+        return nullptr;
+    }
+    framesFused++;
+    return &pool[slot];
+}//pop()
+
+
+
+inline void CaptureQueue::release(DepthSlot* slot)
+{
+    freeSlots.push((int)(slot - pool.data()));
+}//release()
+
+
+
+inline size_t CaptureQueue::memoryBytes() const
+{
+    return pool.size() * pool[0].depth.size() * sizeof(uint16_t);
+}//memoryBytes()
+
+
+
+inline void CaptureQueue::printCounters() const
+{
+    std::cout << "Capture: " << framesCaptured.load() << " frames, " << framesDropped.load() << " dropped, "
+        << blockedMicroseconds.load() / 1000 << " ms blocked, at most " << mostQueued.load() << " queued. Fusion: "
+        << framesFused.load() << " frames picked up, " << filledSlots.count() << " waiting\n";
+}//printCounters()
@@ -0,0 +1,417 @@
+//Cached deprojection for RealSense to OpenPose 3D
+//
+//The intrinsics and extrinsics never change once the baseline has been captured, so the distortion math for every
+//  depth pixel only needs to be done once. DepthRayTable keeps one ray per depth pixel (the point that pixel sees at
+//  a depth of 1 meter), which turns depth -> 3D into a single multiply per axis. The same rays rotated into the color
+//  camera's frame turn depth -> color space into a multiply-add per axis.
+//
+//ColorRayTable does the same for the color camera, whose keypoints land between pixels. It holds the undistorted
+//  normalized coordinates on a grid every gridStep color pixels and interpolates between the four nearest grid points,
+//  so deprojecting a keypoint is a table fetch and a depth multiply no matter the distortion model. A coarser grid uses
+//  less memory and is less exact; the largest error is measured when the table is built.
+//
+//KeypointBatch deprojects every keypoint of a frame at once (color pixel + depth -> 3D) into structure-of-arrays
+//  output. The distortion model is picked once by setCamera(), which hands back a copy of the deprojection compiled
+//  for that model, and the common models are done 8 points at a time with AVX2.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#include <librealsense2/rs.hpp>
+#include <librealsense2/rsutil.h>
+
+#include "./Simd.hpp" //AVX2 detection
+#include "./Distortion.hpp" //Per model projection and deprojection
+
+
+class DepthRayTable
+{
+public:
+    DepthRayTable(const rs2_intrinsics& depthIntrin, const rs2_extrinsics& depth2ColorExtrin);
+
+    //Point seen by depth pixel index in the depth camera's frame
+    void toPoint(int index, float depth, float point[3]) const
+    {
+        point[0] = depth * rayX[index];
+        point[1] = depth * rayY[index];
+        point[2] = depth;
+    }
+
+    //Point seen by depth pixel index in the color camera's frame
+    void toColorPoint(int index, float depth, float point[3]) const
+    {
+        point[0] = depth * colorRayX[index] + translation[0];
+        point[1] = depth * colorRayY[index] + translation[1];
+        point[2] = depth * colorRayZ[index] + translation[2];
+    }
+
+    size_t memoryBytes() const; //Total size of the tables
+
+    int width; //Depth image size
+    int height;
+
+    //Structure of arrays, one entry per depth pixel in row-major order
+    std::vector<float> rayX; //Ray in the depth camera's frame (z is always 1)
+    std::vector<float> rayY;
+    std::vector<float> colorRayX; //Same ray rotated into the color camera's frame
+    std::vector<float> colorRayY;
+    std::vector<float> colorRayZ;
+    float translation[3]; //Depth to color translation
+};
+
+
+
+inline DepthRayTable::DepthRayTable(const rs2_intrinsics& depthIntrin, const rs2_extrinsics& depth2ColorExtrin)
+    : width(depthIntrin.width), height(depthIntrin.height)
+{
+    size_t pixelCount = (size_t)width * height;
+    rayX.resize(pixelCount);
+    rayY.resize(pixelCount);
+    colorRayX.resize(pixelCount);
+    colorRayY.resize(pixelCount);
+    colorRayZ.resize(pixelCount);
+
+    const float* rotation = depth2ColorExtrin.rotation; //Column-major
+    for (int i = 0; i < 3; i++)
+    {
+        translation[i] = depth2ColorExtrin.translation[i];
+    }
+
+    float pixel[2], ray[3];
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            size_t index = (size_t)y * width + x;
+            pixel[0] = (float)x;
+            pixel[1] = (float)y;
+            rs2_deproject_pixel_to_point(ray, &depthIntrin, pixel, 1.0f); //Distortion is handled here, once
+
+            rayX[index] = ray[0];
+            rayY[index] = ray[1];
+            colorRayX[index] = rotation[0] * ray[0] + rotation[3] * ray[1] + rotation[6];
+            colorRayY[index] = rotation[1] * ray[0] + rotation[4] * ray[1] + rotation[7];
+            colorRayZ[index] = rotation[2] * ray[0] + rotation[5] * ray[1] + rotation[8];
+        }
+    }
+}//DepthRayTable()
+
+
+
+inline size_t DepthRayTable::memoryBytes() const
+{
+    return (rayX.size() + rayY.size() + colorRayX.size() + colorRayY.size() + colorRayZ.size()) * sizeof(float);
+}//memoryBytes()
+
+
+
+//Deprojects count color pixels with their depths into structure-of-arrays points
+typedef void (*DeprojectPixelsFunction)(const rs2_intrinsics& intrin, const float* u, const float* v, const float* depth, int count,
+    float* x, float* y, float* z);
+
+DeprojectPixelsFunction selectDeprojection(const rs2_intrinsics& intrin); //The fastest version for intrin's model and this CPU
+
+
+
+class ColorRayTable
+{
+public:
+    ColorRayTable(const rs2_intrinsics& colorIntrin, int gridStep);
+
+    //Undistorted normalized coordinates (the point at a depth of 1 meter) of a subpixel color position
+    void ray(float u, float v, float& rayXOut, float& rayYOut) const
+    {
+        float gridU = std::min(std::max(u * inverseStep, 0.0f), (float)(columns - 1)); //Clamp to the last cell
+        float gridV = std::min(std::max(v * inverseStep, 0.0f), (float)(rows - 1));
+        int cellU = std::min((int)gridU, columns - 2);
+        int cellV = std::min((int)gridV, rows - 2);
+        float weightU = gridU - cellU;
+        float weightV = gridV - cellV;
+
+        size_t index = (size_t)cellV * columns + cellU;
+        float top = rayX[index] + (rayX[index + 1] - rayX[index]) * weightU;
+        float bottom = rayX[index + columns] + (rayX[index + columns + 1] - rayX[index + columns]) * weightU;
+        rayXOut = top + (bottom - top) * weightV;
+        top = rayY[index] + (rayY[index + 1] - rayY[index]) * weightU;
+        bottom = rayY[index + columns] + (rayY[index + columns + 1] - rayY[index + columns]) * weightU;
+        rayYOut = top + (bottom - top) * weightV;
+    }
+
+    void deproject(const float* u, const float* v, const float* depth, int count, float* x, float* y, float* z) const;
+
+    size_t memoryBytes() const { return (rayX.size() + rayY.size()) * sizeof(float); }
+    float maxErrorPixels() const { return maxError; } //Worst interpolation error found in the middle of the cells, in color pixels
+
+private:
+    int step;
+    float inverseStep;
+    int columns; //Grid points, the last row and column reach the far edge of the image
+    int rows;
+    std::vector<float> rayX;
+    std::vector<float> rayY;
+    float maxError;
+};
+
+
+
+struct KeypointBatch
+{
+    std::vector<float> u; //Color pixels
+    std::vector<float> v;
+    std::vector<float> depth; //Meters behind each pixel, 0 if there is none
+    std::vector<float> x; //Deprojected points in the color camera's frame
+    std::vector<float> y;
+    std::vector<float> z;
+
+    //The vectors are kept between frames so their memory is reused
+    void clear()
+    {
+        u.clear();
+        v.clear();
+        depth.clear();
+    }
+
+    void add(float pixelU, float pixelV)
+    {
+        u.push_back(pixelU);
+        v.push_back(pixelV);
+        depth.push_back(0);
+    }
+
+    size_t size() const { return u.size(); }
+
+    void setCamera(const rs2_intrinsics& intrin, const ColorRayTable* table = nullptr); //Picks the deprojection, call once the intrinsics are known
+    void deproject(); //Fills x, y, and z from u, v, and depth
+    void sizeOutput(); //Makes room in x, y, and z for every keypoint, before deprojecting parts of the batch
+    void deproject(size_t first, size_t count); //Only keypoints first ... first + count - 1, threads may each do their own part
+
+private:
+    rs2_intrinsics intrinsics;
+    DeprojectPixelsFunction deprojectPixels = nullptr;
+    const ColorRayTable* rayTable = nullptr; //Used instead of deprojectPixels when there is one
+};
+
+
+
+#ifdef SIMD_X86
+//Same math as deprojectPixel() for 8 pixels at a time. Returns how many pixels were done (a multiple of 8).
+template <rs2_distortion Model>
+SIMD_AVX2 inline int deprojectPixelsAvx2(const rs2_intrinsics& intrin, const float* u, const float* v, const float* depth, int count,
+    float* x, float* y, float* z)
+{
+    const __m256 ppx = _mm256_set1_ps(intrin.ppx);
+    const __m256 ppy = _mm256_set1_ps(intrin.ppy);
+    const __m256 fx = _mm256_set1_ps(intrin.fx);
+    const __m256 fy = _mm256_set1_ps(intrin.fy);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 k1 = _mm256_set1_ps(intrin.coeffs[0]);
+    const __m256 k2 = _mm256_set1_ps(intrin.coeffs[1]);
+    const __m256 p1 = _mm256_set1_ps(intrin.coeffs[2]);
+    const __m256 p2 = _mm256_set1_ps(intrin.coeffs[3]);
+    const __m256 k3 = _mm256_set1_ps(intrin.coeffs[4]);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 px = _mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(u + i), ppx), fx);
+        __m256 py = _mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(v + i), ppy), fy);
+
+        if (Model == RS2_DISTORTION_INVERSE_BROWN_CONRADY)
+        {
+            __m256 r2 = _mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py));
+            __m256 f = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(one, _mm256_mul_ps(k1, r2)), _mm256_mul_ps(_mm256_mul_ps(k2, r2), r2)),
+                _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(k3, r2), r2), r2));
+            __m256 ux = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, f), _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(two, p1), px), py)),
+                _mm256_mul_ps(p2, _mm256_add_ps(r2, _mm256_mul_ps(_mm256_mul_ps(two, px), px))));
+            __m256 uy = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(py, f), _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(two, p2), px), py)),
+                _mm256_mul_ps(p1, _mm256_add_ps(r2, _mm256_mul_ps(_mm256_mul_ps(two, py), py))));
+            px = ux;
+            py = uy;
+        }
+        else if (Model == RS2_DISTORTION_BROWN_CONRADY) //Iterative undistortion
+        {
+            __m256 xo = px;
+            __m256 yo = py;
+            for (int iteration = 0; iteration < 10; iteration++)
+            {
+                __m256 r2 = _mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py));
+                __m256 icdist = _mm256_div_ps(one, _mm256_add_ps(one, _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(k3, r2), k2), r2), k1), r2)));
+                __m256 xq = _mm256_div_ps(px, icdist);
+                __m256 yq = _mm256_div_ps(py, icdist);
+                __m256 deltaX = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(two, p1), xq), yq),
+                    _mm256_mul_ps(p2, _mm256_add_ps(r2, _mm256_mul_ps(_mm256_mul_ps(two, xq), xq))));
+                __m256 deltaY = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(two, p2), xq), yq),
+                    _mm256_mul_ps(p1, _mm256_add_ps(r2, _mm256_mul_ps(_mm256_mul_ps(two, yq), yq))));
+                px = _mm256_mul_ps(_mm256_sub_ps(xo, deltaX), icdist);
+                py = _mm256_mul_ps(_mm256_sub_ps(yo, deltaY), icdist);
+            }
+        }
+
+        __m256 d = _mm256_loadu_ps(depth + i);
+        _mm256_storeu_ps(x + i, _mm256_mul_ps(d, px));
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(d, py));
+        _mm256_storeu_ps(z + i, d);
+    }
+    _mm256_zeroupper();
+    return i;
+}//deprojectPixelsAvx2()
+#endif
+
+
+
+//Scalar version of one model, also finishes the pixels left over by the AVX2 version
+template <rs2_distortion Model>
+inline void deprojectPixelsScalar(const rs2_intrinsics& intrin, const float* u, const float* v, const float* depth, int count,
+    float* x, float* y, float* z)
+{
+    float pixel[2], point[3];
+    for (int i = 0; i < count; i++)
+    {
+        pixel[0] = u[i];
+        pixel[1] = v[i];
+        deprojectPixel<Model>(point, intrin, pixel, depth[i]);
+        x[i] = point[0];
+        y[i] = point[1];
+        z[i] = point[2];
+    }
+}//deprojectPixelsScalar()
+
+
+
+#ifdef SIMD_X86
+template <rs2_distortion Model>
+inline void deprojectPixelsSimd(const rs2_intrinsics& intrin, const float* u, const float* v, const float* depth, int count,
+    float* x, float* y, float* z)
+{
+    int done = deprojectPixelsAvx2<Model>(intrin, u, v, depth, count, x, y, z);
+    deprojectPixelsScalar<Model>(intrin, u + done, v + done, depth + done, count - done, x + done, y + done, z + done); //Leftovers
+}//deprojectPixelsSimd()
+#endif
+
+
+
+inline DeprojectPixelsFunction selectDeprojection(const rs2_intrinsics& intrin)
+{
+#ifdef SIMD_X86
+    if (cpuHasAvx2())
+    {
+        switch (intrin.model)
+        {
+        case RS2_DISTORTION_NONE: return deprojectPixelsSimd<RS2_DISTORTION_NONE>;
+        case RS2_DISTORTION_INVERSE_BROWN_CONRADY: return deprojectPixelsSimd<RS2_DISTORTION_INVERSE_BROWN_CONRADY>;
+        case RS2_DISTORTION_BROWN_CONRADY: return deprojectPixelsSimd<RS2_DISTORTION_BROWN_CONRADY>;
+        default: break; //Kannala-Brandt needs atan/tan, which AVX2 doesn't have
+        }
+    }
+#endif
+
+    switch (intrin.model)
+    {
+    case RS2_DISTORTION_NONE: return deprojectPixelsScalar<RS2_DISTORTION_NONE>;
+    case RS2_DISTORTION_INVERSE_BROWN_CONRADY: return deprojectPixelsScalar<RS2_DISTORTION_INVERSE_BROWN_CONRADY>;
+    case RS2_DISTORTION_BROWN_CONRADY: return deprojectPixelsScalar<RS2_DISTORTION_BROWN_CONRADY>;
+    case RS2_DISTORTION_KANNALA_BRANDT4: return deprojectPixelsScalar<RS2_DISTORTION_KANNALA_BRANDT4>;
+    default: return deprojectPixelsScalar<ANY_DISTORTION>;
+    }
+}//selectDeprojection()
+
+
+
+inline ColorRayTable::ColorRayTable(const rs2_intrinsics& colorIntrin, int gridStep)
+    : step(std::max(1, gridStep)), inverseStep(1.0f / step), maxError(0)
+{
+    columns = (colorIntrin.width + step - 1) / step + 1;
+    rows = (colorIntrin.height + step - 1) / step + 1;
+    rayX.resize((size_t)columns * rows);
+    rayY.resize((size_t)columns * rows);
+
+    DeprojectPixelsFunction deprojectRow = selectDeprojection(colorIntrin);
+    std::vector<float> u(columns), v(columns), ones(columns, 1.0f), z(columns);
+    for (int column = 0; column < columns; column++)
+    {
+        u[column] = (float)(column * step);
+    }
+    for (int row = 0; row < rows; row++) //One grid row at a time
+    {
+        std::fill(v.begin(), v.end(), (float)(row * step));
+        size_t first = (size_t)row * columns;
+        deprojectRow(colorIntrin, u.data(), v.data(), ones.data(), columns, &rayX[first], &rayY[first], z.data());
+    }
+
+    //Check the middle of every cell, where the interpolation is the furthest from the grid points
+    if (step > 1)
+    {
+        float pixel[2], point[3], estimateX, estimateY;
+        for (int row = 0; row + 1 < rows; row++)
+        {
+            for (int column = 0; column + 1 < columns; column++)
+            {
+                pixel[0] = (column + 0.5f) * step;
+                pixel[1] = (row + 0.5f) * step;
+                rs2_deproject_pixel_to_point(point, &colorIntrin, pixel, 1.0f);
+                ray(pixel[0], pixel[1], estimateX, estimateY);
+                maxError = std::max(maxError, std::max(std::fabs(estimateX - point[0]) * colorIntrin.fx, std::fabs(estimateY - point[1]) * colorIntrin.fy));
+            }
+        }
+    }
+}//ColorRayTable()
+
+
+
+inline void ColorRayTable::deproject(const float* u, const float* v, const float* depth, int count, float* x, float* y, float* z) const
+{
+    float pointX, pointY;
+    for (int i = 0; i < count; i++)
+    {
+        ray(u[i], v[i], pointX, pointY);
+        x[i] = depth[i] * pointX;
+        y[i] = depth[i] * pointY;
+        z[i] = depth[i];
+    }
+}//deproject()
+
+
+
+inline void KeypointBatch::setCamera(const rs2_intrinsics& intrin, const ColorRayTable* table)
+{
+    intrinsics = intrin;
+    deprojectPixels = selectDeprojection(intrin);
+    rayTable = table;
+}//setCamera()
+
+
+
+inline void KeypointBatch::deproject()
+{
+    sizeOutput();
+    deproject(0, u.size());
+}//deproject()
+
+
+
+inline void KeypointBatch::sizeOutput()
+{
+    x.resize(u.size());
+    y.resize(u.size());
+    z.resize(u.size());
+}//sizeOutput()
+
+
+
+inline void KeypointBatch::deproject(size_t first, size_t count)
+{
+    if (rayTable)
+    {
+        rayTable->deproject(u.data() + first, v.data() + first, depth.data() + first, (int)count, x.data() + first, y.data() + first, z.data() + first);
+    }
+    else
+    {
+        deprojectPixels(intrinsics, u.data() + first, v.data() + first, depth.data() + first, (int)count, x.data() + first, y.data() + first, z.data() + first);
+    }
+}//deproject()
@@ -0,0 +1,141 @@
+//Timestamped depth ring buffer for RealSense to OpenPose 3D
+//
+//A keypoint file shows up well after the color image it came from was taken (OpenPose's processing plus writing the
+//  file), so the newest depth frame is usually newer than the keypoints. Each depth frame is copied into a DepthSlot
+//  (from a pool allocated at startup, see CaptureQueue.hpp) together with its hardware timestamp and the system time
+//  it arrived. DepthRingBuffer holds the last few slots and finds the one captured closest to when the OpenPose image
+//  is estimated to have been taken (the file's write time minus the measured pipeline delay). Nothing is allocated per
+//  frame and no librealsense frames are held, so the frame pool never runs dry no matter how many slots there are.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <librealsense2/rs.hpp>
+
+
+struct DepthSlot
+{
+    std::vector<uint16_t> depth; //Z16 pixels, allocated once
+    int width;
+    int height;
+    unsigned long long frameNumber;
+    double hardwareTimestamp; //Milliseconds in timestampDomain, from the camera
+    rs2_timestamp_domain timestampDomain;
+    std::chrono::system_clock::time_point arrival; //When the program received the frame
+    std::chrono::system_clock::time_point captured; //Best estimate of when the camera took the frame
+
+    void allocate(int depthWidth, int depthHeight);
+    void copyFrom(const rs2::depth_frame& frame, std::chrono::system_clock::time_point arrivalTime); //No allocation
+};
+
+
+
+class DepthRingBuffer
+{
+public:
+    explicit DepthRingBuffer(int slotCount);
+
+    DepthSlot* add(DepthSlot* slot); //Returns the slot that fell out (to be reused), or nullptr while there is room
+
+    const DepthSlot* newest() const { return count > 0 ? slots[(head + capacity - 1) % capacity] : nullptr; }
+    const DepthSlot& closest(std::chrono::system_clock::time_point captureTime) const; //The slot captured closest to captureTime, there must be at least one
+
+    int size() const { return count; }
+
+private:
+    int capacity;
+    std::vector<DepthSlot*> slots;
+    int head; //Next position to write
+    int count; //Slots held, up to capacity
+};
+
+
+
+inline void DepthSlot::allocate(int depthWidth, int depthHeight)
+{
+    width = depthWidth;
+    height = depthHeight;
+    depth.resize((size_t)width * height);
+    frameNumber = 0;
+    hardwareTimestamp = 0;
+    timestampDomain = RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME;
+}//allocate()
+
+
+
+inline void DepthSlot::copyFrom(const rs2::depth_frame& frame, std::chrono::system_clock::time_point arrivalTime)
+{
+    //Copy row by row in case the frame's rows are padded
+    const uint8_t* source = (const uint8_t*)frame.get_data();
+    int stride = frame.get_stride_in_bytes();
+    size_t rowBytes = (size_t)width * sizeof(uint16_t);
+    if (stride == (int)rowBytes)
+    {
+        std::memcpy(depth.data(), source, rowBytes * height);
+    }
+    else
+    {
+        for (int y = 0; y < height; y++)
+        {
+            std::memcpy(&depth[(size_t)y * width], source + (size_t)y * stride, rowBytes);
+        }
+    }
+
+    frameNumber = frame.get_frame_number();
+    hardwareTimestamp = frame.get_timestamp();
+    timestampDomain = frame.get_frame_timestamp_domain();
+    arrival = arrivalTime;
+    if (timestampDomain == RS2_TIMESTAMP_DOMAIN_GLOBAL_TIME || timestampDomain == RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME) //Already host time
+    {
+        captured = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::duration<double, std::milli>(hardwareTimestamp)));
+    }
+    else //The camera's own clock can't be compared with file times
+    {
+        captured = arrival;
+    }
+}//copyFrom()
+
+
+
+inline DepthRingBuffer::DepthRingBuffer(int slotCount)
+    : capacity(slotCount < 1 ? 1 : slotCount), slots(capacity, nullptr), head(0), count(0)
+{
+}//DepthRingBuffer()
+
+
+
+inline DepthSlot* DepthRingBuffer::add(DepthSlot* slot)
+{
+    DepthSlot* oldest = count == capacity ? slots[head] : nullptr;
+    slots[head] = slot;
+    head = (head + 1) % capacity;
+    if (count < capacity)
+    {
+        count++;
+    }
+    return oldest;
+}//add()
+
+
+
+inline const DepthSlot& DepthRingBuffer::closest(std::chrono::system_clock::time_point captureTime) const
+{
+    int best = (head + capacity - 1) % capacity; //Newest
+    std::chrono::system_clock::duration bestGap = std::chrono::system_clock::duration::max();
+    for (int i = 0; i < count; i++)
+    {
+        int index = (head + capacity - 1 - i) % capacity; //Newest to oldest
+        std::chrono::system_clock::duration gap = slots[index]->captured > captureTime ? slots[index]->captured - captureTime : captureTime - slots[index]->captured;
+        if (gap < bestGap)
+        {
+            best = index;
+            bestGap = gap;
+        }
+    }
+    return *slots[best];
+}//closest()
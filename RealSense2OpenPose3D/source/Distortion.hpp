@@ -0,0 +1,141 @@
+//Distortion models for RealSense to OpenPose 3D
+//
+//rs2_project_point_to_pixel() and rs2_deproject_pixel_to_point() check intrin->model for every point, but a camera's
+//  model never changes while the program runs. These are the same functions with the model as a template parameter,
+//  so each model gets its own copy with no branches left for the compiler to inline and vectorize. The math and its
+//  order are copied from librealsense's rsutil.h so the results match it exactly.
+//The model is picked once at startup by whoever holds the intrinsics (see selectDeprojection() and SparseRegistration).
+//  ANY_DISTORTION stands in for the models without their own copy and simply calls rsutil.h.
+
+#pragma once
+
+#include <cmath>
+#include <cfloat>
+
+#include <librealsense2/rs.hpp>
+#include <librealsense2/rsutil.h>
+
+
+const rs2_distortion ANY_DISTORTION = RS2_DISTORTION_COUNT; //Not a real model, checks intrin.model at run time like rsutil.h
+
+
+
+template <rs2_distortion Model>
+inline void projectPoint(float pixel[2], const rs2_intrinsics& intrin, const float point[3])
+{
+    if (Model == ANY_DISTORTION)
+    {
+        rs2_project_point_to_pixel(pixel, &intrin, point);
+        return;
+    }
+
+    float x = point[0] / point[2], y = point[1] / point[2];
+
+    if (Model == RS2_DISTORTION_INVERSE_BROWN_CONRADY)
+    {
+        float r2 = x * x + y * y;
+        float f = 1 + intrin.coeffs[0] * r2 + intrin.coeffs[1] * r2 * r2 + intrin.coeffs[4] * r2 * r2 * r2;
+        x *= f;
+        y *= f;
+        float dx = x + 2 * intrin.coeffs[2] * x * y + intrin.coeffs[3] * (r2 + 2 * x * x);
+        float dy = y + 2 * intrin.coeffs[3] * x * y + intrin.coeffs[2] * (r2 + 2 * y * y);
+        x = dx;
+        y = dy;
+    }
+    else if (Model == RS2_DISTORTION_BROWN_CONRADY)
+    {
+        float r2 = x * x + y * y;
+        float f = 1 + intrin.coeffs[0] * r2 + intrin.coeffs[1] * r2 * r2 + intrin.coeffs[4] * r2 * r2 * r2;
+        float xf = x * f;
+        float yf = y * f;
+        float dx = xf + 2 * intrin.coeffs[2] * x * y + intrin.coeffs[3] * (r2 + 2 * x * x);
+        float dy = yf + 2 * intrin.coeffs[3] * x * y + intrin.coeffs[2] * (r2 + 2 * y * y);
+        x = dx;
+        y = dy;
+    }
+    else if (Model == RS2_DISTORTION_KANNALA_BRANDT4)
+    {
+        float r = std::sqrt(x * x + y * y);
+        if (r < FLT_EPSILON)
+        {
+            r = FLT_EPSILON;
+        }
+        float theta = std::atan(r);
+        float theta2 = theta * theta;
+        float series = 1 + theta2 * (intrin.coeffs[0] + theta2 * (intrin.coeffs[1] + theta2 * (intrin.coeffs[2] + theta2 * intrin.coeffs[3])));
+        float rd = theta * series;
+        x *= rd / r;
+        y *= rd / r;
+    }
+
+    pixel[0] = x * intrin.fx + intrin.ppx;
+    pixel[1] = y * intrin.fy + intrin.ppy;
+}//projectPoint()
+
+
+
+template <rs2_distortion Model>
+inline void deprojectPixel(float point[3], const rs2_intrinsics& intrin, const float pixel[2], float depth)
+{
+    if (Model == ANY_DISTORTION)
+    {
+        rs2_deproject_pixel_to_point(point, &intrin, pixel, depth);
+        return;
+    }
+
+    float x = (pixel[0] - intrin.ppx) / intrin.fx;
+    float y = (pixel[1] - intrin.ppy) / intrin.fy;
+
+    if (Model == RS2_DISTORTION_BROWN_CONRADY) //Iterative undistortion
+    {
+        float xo = x, yo = y;
+        for (int i = 0; i < 10; i++)
+        {
+            float r2 = x * x + y * y;
+            float icdist = (float)1 / (float)(1 + ((intrin.coeffs[4] * r2 + intrin.coeffs[1]) * r2 + intrin.coeffs[0]) * r2);
+            float xq = x / icdist;
+            float yq = y / icdist;
+            float deltaX = 2 * intrin.coeffs[2] * xq * yq + intrin.coeffs[3] * (r2 + 2 * xq * xq);
+            float deltaY = 2 * intrin.coeffs[3] * xq * yq + intrin.coeffs[2] * (r2 + 2 * yq * yq);
+            x = (xo - deltaX) * icdist;
+            y = (yo - deltaY) * icdist;
+        }
+    }
+    else if (Model == RS2_DISTORTION_INVERSE_BROWN_CONRADY)
+    {
+        float r2 = x * x + y * y;
+        float f = 1 + intrin.coeffs[0] * r2 + intrin.coeffs[1] * r2 * r2 + intrin.coeffs[4] * r2 * r2 * r2;
+        float ux = x * f + 2 * intrin.coeffs[2] * x * y + intrin.coeffs[3] * (r2 + 2 * x * x);
+        float uy = y * f + 2 * intrin.coeffs[3] * x * y + intrin.coeffs[2] * (r2 + 2 * y * y);
+        x = ux;
+        y = uy;
+    }
+    else if (Model == RS2_DISTORTION_KANNALA_BRANDT4) //Newton's method on the angle
+    {
+        float rd = std::sqrt(x * x + y * y);
+        if (rd < FLT_EPSILON)
+        {
+            rd = FLT_EPSILON;
+        }
+        float theta = rd;
+        float theta2 = rd * rd;
+        for (int i = 0; i < 4; i++)
+        {
+            float f = theta * (1 + theta2 * (intrin.coeffs[0] + theta2 * (intrin.coeffs[1] + theta2 * (intrin.coeffs[2] + theta2 * intrin.coeffs[3])))) - rd;
+            if (std::fabs(f) < FLT_EPSILON)
+            {
+                break;
+            }
+            float df = 1 + theta2 * (3 * intrin.coeffs[0] + theta2 * (5 * intrin.coeffs[1] + theta2 * (7 * intrin.coeffs[2] + 9 * theta2 * intrin.coeffs[3])));
+            theta -= f / df;
+            theta2 = theta * theta;
+        }
+        float r = std::tan(theta);
+        x *= r / rd;
+        y *= r / rd;
+    }
+
+    point[0] = depth * x;
+    point[1] = depth * y;
+    point[2] = depth;
+}//deprojectPixel()
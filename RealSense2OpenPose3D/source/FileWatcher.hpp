@@ -0,0 +1,354 @@
+//OpenPose output watcher for RealSense to OpenPose 3D
+//
+//Trying to open the next keypoint file on every depth frame costs a failed open most of the time and sometimes catches
+//  OpenPose halfway through writing it. KeypointFileWatcher asks the OS for directory events instead and only reports a
+//  *_keypoints.json file once OpenPose is done with it:
+//      Linux: inotify IN_CLOSE_WRITE and IN_MOVED_TO, which only fire once the writer has closed or renamed the file
+//      Windows: ReadDirectoryChangesW names the files that changed, then a file counts as done once it can be opened
+//          without sharing write access (which fails while OpenPose still has it open)
+//  Both are read without blocking, so checking for a file is one read of whatever events are queued. If events are
+//  not available (or polling is asked for) the watcher falls back to trying to open the file like before. It also polls
+//  at startup (files already in the directory never get an event) and after events were lost, until the first file
+//  that doesn't open yet, since OpenPose writes its files in order and every later one will get an event. A polled
+//  file may still be being written, so like before that relies on the caller noticing it couldn't be read and calling
+//  retry(). Its event may also come in after it was polled: the zero-padded names sort in frame order, so anything
+//  before the file asked for is already done with and is thrown away.
+//fileWriteTime() gives when OpenPose last wrote a file, for matching it to the depth frames around that time.
+
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+
+#include "./Paths.hpp"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX //Keep std::min and std::max usable
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#define WATCHER_WINDOWS
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define WATCHER_INOTIFY
+#endif
+
+
+class KeypointFileWatcher
+{
+public:
+    KeypointFileWatcher(const std::string& directoryPath, bool useEvents = true);
+    ~KeypointFileWatcher();
+
+    //True once fileName (in the watched directory, with or without a leading separator) has been completely written.
+    //  Each file is only reported once.
+    bool fileReady(const std::string& fileName);
+    void retry(const std::string& fileName); //Reports fileName again next time, for files that could not be read after all
+
+    bool usingEvents() const { return watching; }
+    int pendingCount() const { return (int)finished.size(); } //Files with events that have not been asked for yet
+    bool fileExists(const std::string& fileName) const { return fileOpens(bareName(fileName)); } //Asks the disk, not the events
+
+private:
+    static std::string bareName(const std::string& fileName); //Without a leading separator
+    void readEvents(); //Moves any queued events into finished
+    void addName(const std::string& name);
+    bool fileOpens(const std::string& name) const; //The polling check
+
+    std::string directory;
+    bool watching; //False means polling
+    bool overflowed; //Events may be missing (startup, or the OS dropped some), so poll until a file doesn't open
+    std::set<std::string> finished; //Keypoint files that are done but not yet asked for, in frame order
+
+#if defined(WATCHER_INOTIFY)
+    int inotifyHandle;
+    int watchHandle;
+#elif defined(WATCHER_WINDOWS)
+    bool writerClosed(const std::string& name) const;
+    bool startRead(); //Queues the next ReadDirectoryChangesW
+
+    HANDLE directoryHandle;
+    OVERLAPPED overlapped;
+    DWORD buffer[16384]; //DWORD aligned as ReadDirectoryChangesW requires
+    std::set<std::string> changed; //Files with events that may still be open in OpenPose, in frame order
+#endif
+};
+
+
+
+inline KeypointFileWatcher::KeypointFileWatcher(const std::string& directoryPath, bool useEvents)
+    : directory(directoryPath), watching(false), overflowed(true)
+{
+#if defined(WATCHER_INOTIFY)
+    inotifyHandle = -1;
+    watchHandle = -1;
+    if (useEvents)
+    {
+        inotifyHandle = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyHandle >= 0)
+        {
+            watchHandle = inotify_add_watch(inotifyHandle, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        }
+        watching = watchHandle >= 0;
+    }
+#elif defined(WATCHER_WINDOWS)
+    directoryHandle = INVALID_HANDLE_VALUE;
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    if (useEvents)
+    {
+        directoryHandle = CreateFileA(directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+        if (directoryHandle != INVALID_HANDLE_VALUE)
+        {
+            overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+            watching = overlapped.hEvent != NULL && startRead();
+        }
+    }
+#endif
+
+    if (useEvents && !watching)
+    {
+        std::cout << "Could not watch \"" << directory << "\" for new files, checking for them every frame instead.\n";
+    }
+}//KeypointFileWatcher()
+
+
+
+inline KeypointFileWatcher::~KeypointFileWatcher()
+{
+#if defined(WATCHER_INOTIFY)
+    if (inotifyHandle >= 0)
+    {
+        close(inotifyHandle); //Also removes the watch
+    }
+#elif defined(WATCHER_WINDOWS)
+    if (directoryHandle != INVALID_HANDLE_VALUE)
+    {
+        CancelIo(directoryHandle);
+        CloseHandle(directoryHandle);
+    }
+    if (overlapped.hEvent != NULL)
+    {
+        CloseHandle(overlapped.hEvent);
+    }
+#endif
+}//~KeypointFileWatcher()
+
+
+
+inline bool KeypointFileWatcher::fileReady(const std::string& fileName)
+{
+    std::string name = bareName(fileName);
+    if (!watching)
+    {
+        return fileOpens(name);
+    }
+
+    readEvents();
+    finished.erase(finished.begin(), finished.lower_bound(name)); //Late events of files that were polled
+#if defined(WATCHER_WINDOWS)
+    changed.erase(changed.begin(), changed.lower_bound(name));
+#endif
+    if (finished.erase(name) > 0)
+    {
+        return true;
+    }
+    if (overflowed) //This file's event might have been dropped, or it was written before the watch started
+    {
+        if (!fileOpens(name)) //Not written yet, so its event (and every later file's) is still to come
+        {
+            overflowed = false;
+            return false;
+        }
+#if defined(WATCHER_WINDOWS)
+        changed.erase(name); //In case its event did arrive after all
+#endif
+        return true;
+    }
+    return false;
+}//fileReady()
+
+
+
+inline void KeypointFileWatcher::retry(const std::string& fileName)
+{
+    if (watching)
+    {
+        finished.insert(bareName(fileName));
+    }
+}//retry()
+
+
+
+inline std::string KeypointFileWatcher::bareName(const std::string& fileName)
+{
+    if (!fileName.empty() && (fileName[0] == '\\' || fileName[0] == '/'))
+    {
+        return fileName.substr(1);
+    }
+    return fileName;
+}//bareName()
+
+
+
+inline void KeypointFileWatcher::addName(const std::string& name)
+{
+    static const std::string suffix = "_keypoints.json"; //Skips the *_keypointsD.json files this program writes
+    if (name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+    {
+#if defined(WATCHER_WINDOWS)
+        changed.insert(name); //Not done until OpenPose lets go of it
+#else
+        finished.insert(name);
+#endif
+    }
+}//addName()
+
+
+
+inline bool KeypointFileWatcher::fileOpens(const std::string& name) const
+{
+    std::ifstream file(joinPath(directory, name));
+    return file.good();
+}//fileOpens()
+
+
+
+#if defined(WATCHER_INOTIFY)
+inline void KeypointFileWatcher::readEvents()
+{
+    alignas(inotify_event) char events[4096];
+    while (true)
+    {
+        ssize_t length = read(inotifyHandle, events, sizeof(events));
+        if (length <= 0) //EAGAIN, nothing else is queued
+        {
+            return;
+        }
+
+        for (char* next = events; next < events + length; )
+        {
+            const inotify_event* event = (const inotify_event*)next;
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                overflowed = true;
+            }
+            else if (event->len > 0)
+            {
+                addName(event->name);
+            }
+            next += sizeof(inotify_event) + event->len;
+        }
+    }
+}//readEvents()
+#elif defined(WATCHER_WINDOWS)
+inline bool KeypointFileWatcher::startRead()
+{
+    return ReadDirectoryChangesW(directoryHandle, buffer, sizeof(buffer), FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE,
+        NULL, &overlapped, NULL) != 0;
+}//startRead()
+
+
+
+inline void KeypointFileWatcher::readEvents()
+{
+    DWORD length = 0;
+    while (GetOverlappedResult(directoryHandle, &overlapped, &length, FALSE)) //A read finished
+    {
+        if (length == 0) //The buffer was too small and the events were dropped
+        {
+            overflowed = true;
+        }
+
+        const char* next = (const char*)buffer;
+        while (length > 0)
+        {
+            const FILE_NOTIFY_INFORMATION* event = (const FILE_NOTIFY_INFORMATION*)next;
+            if (event->Action == FILE_ACTION_ADDED || event->Action == FILE_ACTION_MODIFIED || event->Action == FILE_ACTION_RENAMED_NEW_NAME)
+            {
+                char name[MAX_PATH];
+                int nameLength = WideCharToMultiByte(CP_UTF8, 0, event->FileName, event->FileNameLength / sizeof(WCHAR), name, sizeof(name), NULL, NULL);
+                addName(std::string(name, nameLength));
+            }
+            if (event->NextEntryOffset == 0)
+            {
+                break;
+            }
+            next += event->NextEntryOffset;
+        }
+
+        ResetEvent(overlapped.hEvent);
+        if (!startRead())
+        {
+            watching = false;
+            std::cout << "Lost the watch on \"" << directory << "\", checking for files every frame instead.\n";
+            return;
+        }
+    }
+
+    for (auto name = changed.begin(); name != changed.end(); ) //Move the files OpenPose is done with
+    {
+        if (writerClosed(*name))
+        {
+            finished.insert(*name);
+            name = changed.erase(name);
+        }
+        else
+        {
+            name++;
+        }
+    }
+}//readEvents()
+
+
+
+inline bool KeypointFileWatcher::writerClosed(const std::string& name) const
+{
+    HANDLE file = CreateFileA(joinPath(directory, name).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) //Still open for writing (sharing violation) or already gone
+    {
+        return false;
+    }
+    CloseHandle(file);
+    return true;
+}//writerClosed()
+#else
+inline void KeypointFileWatcher::readEvents()
+{
+}//readEvents()
+#endif
+
+
+
+//Last write time of a file, or now if it can't be read
+inline std::chrono::system_clock::time_point fileWriteTime(const std::string& path)
+{
+#if defined(WATCHER_WINDOWS)
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes))
+    {
+        ULARGE_INTEGER ticks; //100 ns since 1601
+        ticks.LowPart = attributes.ftLastWriteTime.dwLowDateTime;
+        ticks.HighPart = attributes.ftLastWriteTime.dwHighDateTime;
+        long long unixTicks = (long long)ticks.QuadPart - 116444736000000000LL; //Since 1970, like system_clock
+        return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::duration<long long, std::ratio<1, 10000000>>(unixTicks)));
+    }
+#elif defined(WATCHER_INOTIFY)
+    struct stat status;
+    if (stat(path.c_str(), &status) == 0)
+    {
+        return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::seconds(status.st_mtim.tv_sec) + std::chrono::nanoseconds(status.st_mtim.tv_nsec)));
+    }
+#endif
+    return std::chrono::system_clock::now();
+}//fileWriteTime()
@@ -0,0 +1,689 @@
+//Streaming keypoint reader for RealSense to OpenPose 3D
+//
+//Registration only needs the numbers in each person's <part>_keypoints_2d arrays, but a full nlohmann DOM allocates a
+//  node for every number and every key in the file, and each lookup after that is another map search. Both readers
+//  here copy the arrays straight into one flat vector (KeypointFile) as they go by and skip everything else (part
+//  candidates, 3D arrays, person ids), so nothing is allocated once the vectors have grown to the size of a crowded
+//  frame.
+//readKeypoints() is written for the shape OpenPose writes: an object whose "people" array holds one object per person
+//  with the named arrays in it. It walks the buffer once, compares keys in place, and converts numbers with
+//  std::from_chars (std::strtod before C++17), which is several times faster than nlohmann's generic lexer. Anything
+//  else in the file is skipped, however it is nested, and a file that is cut short or isn't JSON is an error, not a
+//  crash. It also notes where each person ends and where any <part>_keypoints_3d arrays already are (OpenPose writes
+//  empty ones), so the 3D keypoints can be spliced into the original text (see KeypointWriter.hpp). readKeypointsSax()
+//  reads the keypoints through nlohmann's SAX parser instead; it is kept for benchmark=true to compare with.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<charconv>) && (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L))
+#include <charconv>
+#endif
+#endif
+
+#include "./json.hpp"
+
+
+const int KEYPOINT_PART_COUNT = 4;
+const char* const keypointParts[KEYPOINT_PART_COUNT] = { "pose", "face", "hand_left", "hand_right" }; //OpenPose names its arrays <part>_keypoints_2d
+const size_t NO_POSITION = (size_t)-1; //KeypointFile's byte offsets for something that isn't there
+
+
+//Every person's 2D keypoints from one OpenPose file
+struct KeypointFile
+{
+    std::vector<double> values; //x, y, confidence of every keypoint, person by person in keypointParts order (doubles, so
+                                //  confidences are written back out exactly as OpenPose wrote them)
+    std::vector<size_t> partOffset; //First value of each person's parts, people() * KEYPOINT_PART_COUNT entries
+    std::vector<int> partLength; //Number of values in each of those parts, -1 if the person has no such array
+
+    size_t people() const { return partLength.size() / KEYPOINT_PART_COUNT; }
+    bool hasPart(size_t person, int part) const { return partLength[person * KEYPOINT_PART_COUNT + part] >= 0; }
+    const double* part(size_t person, int part) const { return values.data() + partOffset[person * KEYPOINT_PART_COUNT + part]; }
+    size_t partValues(size_t person, int part) const { return hasPart(person, part) ? (size_t)partLength[person * KEYPOINT_PART_COUNT + part] : 0; }
+
+    //Where each person is in the text, only filled in by readKeypoints()
+    std::vector<size_t> personEnd; //Byte offset of each person's closing brace, NO_POSITION if the entry isn't an object
+    std::vector<size_t> pointsStart; //Byte range of each person's <part>_keypoints_3d value, NO_POSITION if there is none
+    std::vector<size_t> pointsEnd;
+
+    //A person without any parts (yet)
+    void addPerson()
+    {
+        partOffset.insert(partOffset.end(), KEYPOINT_PART_COUNT, values.size());
+        partLength.insert(partLength.end(), KEYPOINT_PART_COUNT, -1);
+        personEnd.push_back(NO_POSITION);
+        pointsStart.insert(pointsStart.end(), KEYPOINT_PART_COUNT, NO_POSITION);
+        pointsEnd.insert(pointsEnd.end(), KEYPOINT_PART_COUNT, NO_POSITION);
+    }
+
+    //The vectors are kept between files so their memory is reused
+    void clear()
+    {
+        values.clear();
+        partOffset.clear();
+        partLength.clear();
+        personEnd.clear();
+        pointsStart.clear();
+        pointsEnd.clear();
+    }
+};
+
+
+
+//SAX events -> KeypointFile. Only the depth of the current position is tracked: the root object is depth 1, the people
+//  array 2, a person 3, and a person's keypoint array 4.
+class KeypointSaxHandler : public nlohmann::json_sax<nlohmann::json>
+{
+public:
+    explicit KeypointSaxHandler(KeypointFile& output) : file(output) {}
+
+    bool null() override { return true; }
+    bool boolean(bool) override { return true; }
+    bool number_integer(number_integer_t value) override { return number((double)value); }
+    bool number_unsigned(number_unsigned_t value) override { return number((double)value); }
+    bool number_float(number_float_t value, const string_t&) override { return number(value); }
+    bool string(string_t&) override { return true; }
+    bool binary(binary_t&) override { return true; }
+
+    bool start_object(std::size_t) override
+    {
+        depth++;
+        if (depth == 3 && inPeople) //A new person, without any parts until their arrays show up
+        {
+            file.addPerson();
+        }
+        return true;
+    }
+
+    bool end_object() override
+    {
+        depth--;
+        return true;
+    }
+
+    bool key(string_t& name) override
+    {
+        if (depth == 1)
+        {
+            peopleKey = name == "people";
+        }
+        else if (depth == 3 && inPeople)
+        {
+            currentPart = partIndex(name);
+        }
+        return true;
+    }
+
+    bool start_array(std::size_t) override
+    {
+        depth++;
+        if (depth == 2 && peopleKey)
+        {
+            inPeople = true;
+        }
+        else if (depth == 4 && inPeople && currentPart >= 0)
+        {
+            size_t entry = (file.people() - 1) * KEYPOINT_PART_COUNT + currentPart;
+            file.partOffset[entry] = file.values.size();
+            file.partLength[entry] = 0;
+            collecting = true;
+        }
+        return true;
+    }
+
+    bool end_array() override
+    {
+        if (depth == 4 && collecting)
+        {
+            size_t entry = (file.people() - 1) * KEYPOINT_PART_COUNT + currentPart;
+            file.partLength[entry] = (int)(file.values.size() - file.partOffset[entry]);
+            collecting = false;
+            currentPart = -1;
+        }
+        else if (depth == 2 && inPeople)
+        {
+            inPeople = false;
+            peopleKey = false;
+        }
+        depth--;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& error) override
+    {
+        errorMessage = error.what();
+        errorId = error.id;
+        return false; //Stop, the caller reports it
+    }
+
+    std::string errorMessage;
+    int errorId = 0;
+
+private:
+    bool number(double value)
+    {
+        if (collecting && depth == 4)
+        {
+            file.values.push_back(value);
+        }
+        return true;
+    }
+
+    static int partIndex(const std::string& name)
+    {
+        static const char suffix[] = "_keypoints_2d";
+        const size_t suffixLength = sizeof(suffix) - 1;
+        if (name.size() <= suffixLength || name.compare(name.size() - suffixLength, suffixLength, suffix) != 0)
+        {
+            return -1;
+        }
+        for (int i = 0; i < KEYPOINT_PART_COUNT; i++)
+        {
+            if (name.size() - suffixLength == std::strlen(keypointParts[i]) && name.compare(0, name.size() - suffixLength, keypointParts[i]) == 0)
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    KeypointFile& file;
+    int depth = 0;
+    bool peopleKey = false; //The last key of the root object was "people"
+    bool inPeople = false;
+    int currentPart = -1; //keypointParts index of the person's current key, -1 if it isn't a 2D keypoint array
+    bool collecting = false;
+};
+
+
+
+//Fills file with the keypoints in text using nlohmann's SAX parser. Returns false, with the parser's message and
+//  exception id, if text is not complete JSON (e.g. OpenPose is still writing it).
+inline bool readKeypointsSax(const std::string& text, KeypointFile& file, std::string& errorMessage, int& errorId)
+{
+    file.clear();
+    KeypointSaxHandler handler(file);
+    if (!nlohmann::json::sax_parse(text, &handler))
+    {
+        errorMessage = handler.errorMessage;
+        errorId = handler.errorId;
+        return false;
+    }
+    return true;
+}//readKeypointsSax()
+
+
+
+//Recursive descent over one OpenPose file, see readKeypoints()
+class KeypointParser
+{
+public:
+    KeypointParser(const char* text, size_t size, KeypointFile& output) : position(text), start(text), end(text + size), file(output) {}
+
+    bool parse(); //False with error() set if the text isn't a complete JSON object
+    std::string error() const; //What went wrong and where
+
+private:
+    bool fail(const char* message)
+    {
+        if (problem == nullptr) //Keep the first, innermost problem
+        {
+            problem = message;
+            problemAt = position;
+        }
+        return false;
+    }
+
+    bool skipSpace() //False at the end of the text
+    {
+        while (position < end && (*position == ' ' || *position == '\n' || *position == '\r' || *position == '\t'))
+        {
+            position++;
+        }
+        return position < end || fail("unexpected end of the file");
+    }
+
+    bool expect(char c)
+    {
+        if (!skipSpace())
+        {
+            return false;
+        }
+        if (*position != c)
+        {
+            return fail("unexpected character");
+        }
+        position++;
+        return true;
+    }
+
+    //After a value inside an object or array: true with closed set if close came next, true if a comma did
+    bool nextItem(char close, bool& closed)
+    {
+        if (!skipSpace())
+        {
+            return false;
+        }
+        closed = *position == close;
+        if (closed || *position == ',')
+        {
+            position++;
+            return true;
+        }
+        return fail("expected ',' or a closing bracket");
+    }
+
+    bool readString(const char*& text, size_t& length, bool& escaped); //The raw characters between the quotes
+    bool readKey(int& part, int& points, bool& people); //Which key it is (part for 2D, points for 3D arrays), the ':' included
+    bool readNumber(double& value);
+    bool skipValue(int depth); //Any JSON value
+    bool readPeople();
+    bool readPerson();
+    bool readPart(int part);
+
+    const char* position;
+    const char* start;
+    const char* end;
+    KeypointFile& file;
+    const char* problem = nullptr;
+    const char* problemAt = nullptr;
+};
+
+
+
+inline bool KeypointParser::readString(const char*& text, size_t& length, bool& escaped)
+{
+    if (!expect('"'))
+    {
+        return false;
+    }
+    text = position;
+    escaped = false;
+    while (position < end && *position != '"')
+    {
+        if (*position == '\\')
+        {
+            escaped = true;
+            position++; //The escaped character can't end the string, \uXXXX needs no special handling to be skipped
+        }
+        else if ((unsigned char)*position < 0x20)
+        {
+            return fail("control character in a string");
+        }
+        position++;
+    }
+    if (position >= end)
+    {
+        return fail("unexpected end of the file in a string");
+    }
+    length = position - text;
+    position++;
+    return true;
+}//readString()
+
+
+
+inline bool KeypointParser::readKey(int& part, int& points, bool& people)
+{
+    const char* key;
+    size_t length;
+    bool escaped;
+    if (!readString(key, length, escaped) || !expect(':'))
+    {
+        return false;
+    }
+
+    const size_t suffixLength = 13; //_keypoints_2d or _keypoints_3d
+    part = -1;
+    points = -1;
+    people = !escaped && length == 6 && std::memcmp(key, "people", 6) == 0;
+    if (escaped || length <= suffixLength)
+    {
+        return true;
+    }
+    int* found = std::memcmp(key + length - suffixLength, "_keypoints_2d", suffixLength) == 0 ? &part
+        : std::memcmp(key + length - suffixLength, "_keypoints_3d", suffixLength) == 0 ? &points : nullptr;
+    if (found != nullptr)
+    {
+        for (int i = 0; i < KEYPOINT_PART_COUNT; i++)
+        {
+            if (length - suffixLength == std::strlen(keypointParts[i]) && std::memcmp(key, keypointParts[i], length - suffixLength) == 0)
+            {
+                *found = i;
+            }
+        }
+    }
+    return true;
+}//readKey()
+
+
+
+inline bool KeypointParser::readNumber(double& value)
+{
+    if (!skipSpace())
+    {
+        return false;
+    }
+    const char* first = position;
+    while (position < end && ((*position >= '0' && *position <= '9') || *position == '-' || *position == '+' || *position == '.' || *position == 'e' || *position == 'E'))
+    {
+        position++;
+    }
+    if (position == first || *first == '+')
+    {
+        return fail("expected a number");
+    }
+
+#if defined(__cpp_lib_to_chars)
+    std::from_chars_result result = std::from_chars(first, position, value);
+    if (result.ec != std::errc() || result.ptr != position)
+    {
+        return fail("malformed number");
+    }
+#else
+    char digits[64]; //strtod needs the number on its own
+    size_t length = position - first;
+    if (length >= sizeof(digits))
+    {
+        return fail("number too long");
+    }
+    std::memcpy(digits, first, length);
+    digits[length] = '\0';
+    char* parsedEnd;
+    value = std::strtod(digits, &parsedEnd);
+    if (parsedEnd != digits + length)
+    {
+        return fail("malformed number");
+    }
+#endif
+    return true;
+}//readNumber()
+
+
+
+inline bool KeypointParser::skipValue(int depth)
+{
+    if (depth > 64)
+    {
+        return fail("nested too deeply");
+    }
+    if (!skipSpace())
+    {
+        return false;
+    }
+
+    bool closed = false;
+    switch (*position)
+    {
+    case '{':
+        position++;
+        if (!skipSpace())
+        {
+            return false;
+        }
+        if (*position == '}')
+        {
+            position++;
+            return true;
+        }
+        while (!closed)
+        {
+            const char* key;
+            size_t length;
+            bool escaped;
+            if (!readString(key, length, escaped) || !expect(':') || !skipValue(depth + 1) || !nextItem('}', closed))
+            {
+                return false;
+            }
+        }
+        return true;
+    case '[':
+        position++;
+        if (!skipSpace())
+        {
+            return false;
+        }
+        if (*position == ']')
+        {
+            position++;
+            return true;
+        }
+        while (!closed)
+        {
+            if (!skipValue(depth + 1) || !nextItem(']', closed))
+            {
+                return false;
+            }
+        }
+        return true;
+    case '"':
+    {
+        const char* text;
+        size_t length;
+        bool escaped;
+        return readString(text, length, escaped);
+    }
+    case 't':
+    case 'f':
+    case 'n':
+    {
+        const char* word = *position == 't' ? "true" : *position == 'f' ? "false" : "null";
+        size_t length = std::strlen(word);
+        if ((size_t)(end - position) < length || std::memcmp(position, word, length) != 0)
+        {
+            return fail("unknown literal");
+        }
+        position += length;
+        return true;
+    }
+    default:
+    {
+        double number;
+        return readNumber(number);
+    }
+    }
+}//skipValue()
+
+
+
+inline bool KeypointParser::readPart(int part)
+{
+    size_t entry = (file.people() - 1) * KEYPOINT_PART_COUNT + part;
+    file.partOffset[entry] = file.values.size();
+    file.partLength[entry] = 0;
+
+    if (!expect('[') || !skipSpace())
+    {
+        return false;
+    }
+    bool closed = *position == ']';
+    if (closed)
+    {
+        position++;
+    }
+    while (!closed)
+    {
+        double value;
+        if (!readNumber(value) || !nextItem(']', closed))
+        {
+            return false;
+        }
+        file.values.push_back(value);
+    }
+    file.partLength[entry] = (int)(file.values.size() - file.partOffset[entry]);
+    return true;
+}//readPart()
+
+
+
+inline bool KeypointParser::readPerson()
+{
+    file.addPerson();
+    size_t person = file.people() - 1;
+
+    if (!expect('{') || !skipSpace())
+    {
+        return false;
+    }
+    bool closed = *position == '}';
+    if (closed)
+    {
+        position++;
+    }
+    while (!closed)
+    {
+        int part;
+        int points;
+        bool people;
+        if (!readKey(part, points, people) || !skipSpace())
+        {
+            return false;
+        }
+        const char* valueStart = position;
+        if (part >= 0 && *position == '[')
+        {
+            if (!readPart(part))
+            {
+                return false;
+            }
+        }
+        else if (!skipValue(1))
+        {
+            return false;
+        }
+        if (points >= 0) //Replaced by the new 3D keypoints when spliced
+        {
+            file.pointsStart[person * KEYPOINT_PART_COUNT + points] = valueStart - start;
+            file.pointsEnd[person * KEYPOINT_PART_COUNT + points] = position - start;
+        }
+        if (!nextItem('}', closed))
+        {
+            return false;
+        }
+    }
+    file.personEnd[person] = position - 1 - start; //nextItem() just went past the '}'
+    return true;
+}//readPerson()
+
+
+
+inline bool KeypointParser::readPeople()
+{
+    if (!expect('[') || !skipSpace())
+    {
+        return false;
+    }
+    bool closed = *position == ']';
+    if (closed)
+    {
+        position++;
+    }
+    while (!closed)
+    {
+        if (!skipSpace())
+        {
+            return false;
+        }
+        if (*position == '{')
+        {
+            if (!readPerson())
+            {
+                return false;
+            }
+        }
+        else //Not an object, still counted as a person without any parts so fusion's people line up with the file's
+        {
+            file.addPerson();
+            if (!skipValue(1))
+            {
+                return false;
+            }
+        }
+        if (!nextItem(']', closed))
+        {
+            return false;
+        }
+    }
+    return true;
+}//readPeople()
+
+
+
+inline bool KeypointParser::parse()
+{
+    if (!expect('{') || !skipSpace())
+    {
+        return false;
+    }
+    bool closed = *position == '}';
+    if (closed)
+    {
+        position++;
+    }
+    while (!closed)
+    {
+        int part;
+        int points;
+        bool people;
+        if (!readKey(part, points, people))
+        {
+            return false;
+        }
+        if (people && skipSpace() && *position == '[')
+        {
+            file.clear(); //Only the last "people" counts, like in the DOM
+            if (!readPeople())
+            {
+                return false;
+            }
+        }
+        else if (!skipValue(1))
+        {
+            return false;
+        }
+        if (!nextItem('}', closed))
+        {
+            return false;
+        }
+    }
+
+    while (position < end && (*position == ' ' || *position == '\n' || *position == '\r' || *position == '\t'))
+    {
+        position++;
+    }
+    return position == end || fail("text after the end of the object");
+}//parse()
+
+
+
+inline std::string KeypointParser::error() const
+{
+    if (problem == nullptr)
+    {
+        return std::string();
+    }
+    return std::string(problem) + " at byte " + std::to_string(problemAt - start);
+}//error()
+
+
+
+//Fills file with the keypoints in text[0 ... size - 1]. Returns false, with what went wrong in errorMessage, if the
+//  text is not a complete JSON object (e.g. OpenPose is still writing it).
+inline bool readKeypoints(const char* text, size_t size, KeypointFile& file, std::string& errorMessage)
+{
+    file.clear();
+    KeypointParser parser(text, size, file);
+    if (!parser.parse())
+    {
+        errorMessage = parser.error();
+        return false;
+    }
+    return true;
+}//readKeypoints()
@@ -0,0 +1,343 @@
+//Compact keypoint writer for RealSense to OpenPose 3D
+//
+//nlohmann's dump(4) indents every number of every array onto its own line and writes the 3D keypoints, which are
+//  floats, with all 17 digits of a double, so most of an output file was spaces and digits no camera can measure.
+//  KeypointWriter writes the same JSON on one line into a reused string (one write call for the whole file, no
+//  allocation once the string has grown). Numbers go through std::to_chars (nlohmann's own shortest round-trip
+//  formatting before C++17): values in *_keypoints_3d arrays are written as the floats they are, and the x, y, z of
+//  each point can be rounded to a fixed number of decimals (3 is millimetres). Everything else is written exactly.
+//splice() doesn't need a DOM at all: the only change to an OpenPose file is each person's 3D keypoints, so it copies
+//  the file's bytes through untouched and writes just the new *_keypoints_3d arrays, in place of the ones OpenPose
+//  left empty or before the person's closing brace, at the positions readKeypoints() noted.
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<charconv>) && (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L))
+#include <charconv>
+#endif
+#endif
+
+#include "./json.hpp"
+#include "./KeypointReader.hpp" //KeypointFile
+
+
+class KeypointWriter
+{
+public:
+    //coordinateDecimals: digits after the decimal point of 3D x, y, and z, -1 for as many as the float needs
+    explicit KeypointWriter(int coordinateDecimals = -1) : decimals(coordinateDecimals) {}
+
+    //Replaces text with document as compact JSON and a newline
+    void write(const nlohmann::json& document, std::string& text) const
+    {
+        text.clear();
+        writeValue(document, false, text);
+        text += '\n';
+    }
+
+    //Replaces text with source, the file readKeypoints() read into file, with the 3D keypoints in points spliced in.
+    //  points holds x, y, z, confidence of every keypoint of every part file has, in the same order.
+    void splice(const std::string& source, const KeypointFile& file, const std::vector<float>& points, std::string& text) const;
+
+private:
+    void writePoints(const float* points, size_t keypoints, std::string& text) const; //A *_keypoints_3d array
+    void writeValue(const nlohmann::json& value, bool points, std::string& text) const; //points: inside a *_keypoints_3d array
+    void writeString(const std::string& value, std::string& text) const;
+    void writeDouble(double value, std::string& text) const;
+    void writeFloat(float value, int fixedDecimals, std::string& text) const; //fixedDecimals -1 for the shortest exact text
+    void writeInteger(long long value, std::string& text) const;
+    void writeUnsigned(unsigned long long value, std::string& text) const;
+
+    int decimals;
+};
+
+
+
+inline void KeypointWriter::writeValue(const nlohmann::json& value, bool points, std::string& text) const
+{
+    switch (value.type())
+    {
+    case nlohmann::json::value_t::object:
+    {
+        text += '{';
+        bool first = true;
+        for (auto item = value.begin(); item != value.end(); ++item)
+        {
+            if (!first)
+            {
+                text += ',';
+            }
+            first = false;
+            const std::string& key = item.key();
+            writeString(key, text);
+            text += ':';
+            bool keyPoints = key.size() > 13 && key.compare(key.size() - 13, 13, "_keypoints_3d") == 0;
+            writeValue(*item, keyPoints && item->is_array(), text);
+        }
+        text += '}';
+        break;
+    }
+    case nlohmann::json::value_t::array:
+    {
+        text += '[';
+        size_t count = value.size();
+        for (size_t i = 0; i < count; i++)
+        {
+            if (i > 0)
+            {
+                text += ',';
+            }
+            const nlohmann::json& item = value[i];
+            if (points && item.is_number())
+            {
+                writeFloat(item.get<float>(), i % 4 == 3 ? -1 : decimals, text); //x, y, z, confidence
+            }
+            else
+            {
+                writeValue(item, false, text);
+            }
+        }
+        text += ']';
+        break;
+    }
+    case nlohmann::json::value_t::string:
+        writeString(value.get_ref<const std::string&>(), text);
+        break;
+    case nlohmann::json::value_t::boolean:
+        text += value.get<bool>() ? "true" : "false";
+        break;
+    case nlohmann::json::value_t::number_integer:
+        writeInteger(value.get<long long>(), text);
+        break;
+    case nlohmann::json::value_t::number_unsigned:
+        writeUnsigned(value.get<unsigned long long>(), text);
+        break;
+    case nlohmann::json::value_t::number_float:
+        writeDouble(value.get<double>(), text);
+        break;
+    default: //null, and binary which JSON can't hold
+        text += "null";
+        break;
+    }
+}//writeValue()
+
+
+
+inline void KeypointWriter::splice(const std::string& source, const KeypointFile& file, const std::vector<float>& points, std::string& text) const
+{
+    text.clear();
+    size_t copied = 0; //Bytes of source already in text
+    size_t keypoint = 0; //First keypoint of the person's next part in points
+    for (size_t i = 0; i < file.people(); i++)
+    {
+        const size_t* pointsStart = &file.pointsStart[i * KEYPOINT_PART_COUNT];
+        const size_t* pointsEnd = &file.pointsEnd[i * KEYPOINT_PART_COUNT];
+        size_t firstKeypoint[KEYPOINT_PART_COUNT];
+        size_t keypointCount[KEYPOINT_PART_COUNT];
+        int order[KEYPOINT_PART_COUNT]; //Parts sorted by where their old 3D array is in the text
+        for (int part = 0; part < KEYPOINT_PART_COUNT; part++)
+        {
+            firstKeypoint[part] = keypoint;
+            keypointCount[part] = file.partValues(i, part) / 3;
+            keypoint += keypointCount[part];
+
+            int j = part;
+            for (; j > 0 && pointsStart[order[j - 1]] > pointsStart[part]; j--)
+            {
+                order[j] = order[j - 1];
+            }
+            order[j] = part;
+        }
+
+        for (int part : order) //Replace the arrays OpenPose wrote
+        {
+            if (keypointCount[part] > 0 && pointsStart[part] != NO_POSITION)
+            {
+                text.append(source, copied, pointsStart[part] - copied);
+                writePoints(points.data() + 4 * firstKeypoint[part], keypointCount[part], text);
+                copied = pointsEnd[part];
+            }
+        }
+
+        if (file.personEnd[i] == NO_POSITION)
+        {
+            continue;
+        }
+        text.append(source, copied, file.personEnd[i] - copied);
+        copied = file.personEnd[i];
+        for (int part = 0; part < KEYPOINT_PART_COUNT; part++) //Add the others, a person with a 2D part isn't empty so a comma always goes first
+        {
+            if (keypointCount[part] > 0 && pointsStart[part] == NO_POSITION) //Like before, no 3D array for a part OpenPose didn't find (an empty 2D array)
+            {
+                text += ",\"";
+                text += keypointParts[part];
+                text += "_keypoints_3d\":";
+                writePoints(points.data() + 4 * firstKeypoint[part], keypointCount[part], text);
+            }
+        }
+    }
+    text.append(source, copied, std::string::npos);
+}//splice()
+
+
+
+inline void KeypointWriter::writePoints(const float* points, size_t keypoints, std::string& text) const
+{
+    text += '[';
+    for (size_t j = 0; j < 4 * keypoints; j++)
+    {
+        if (j > 0)
+        {
+            text += ',';
+        }
+        writeFloat(points[j], j % 4 == 3 ? -1 : decimals, text); //x, y, z, confidence
+    }
+    text += ']';
+}//writePoints()
+
+
+
+//UTF-8 is copied as it is, only quotes, backslashes, and control characters are escaped
+inline void KeypointWriter::writeString(const std::string& value, std::string& text) const
+{
+    static const char hex[] = "0123456789abcdef";
+    text += '"';
+    for (char c : value)
+    {
+        unsigned char byte = (unsigned char)c;
+        if (c == '"' || c == '\\')
+        {
+            text += '\\';
+            text += c;
+        }
+        else if (byte < 0x20)
+        {
+            text += "\\u00";
+            text += hex[byte >> 4];
+            text += hex[byte & 0xF];
+        }
+        else
+        {
+            text += c;
+        }
+    }
+    text += '"';
+}//writeString()
+
+
+
+inline void KeypointWriter::writeDouble(double value, std::string& text) const
+{
+    if (!std::isfinite(value)) //Like nlohmann, JSON has no infinity or NaN
+    {
+        text += "null";
+        return;
+    }
+    char digits[64];
+#if defined(__cpp_lib_to_chars)
+    char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+#else
+    char* end = nlohmann::detail::to_chars(digits, digits + sizeof(digits), value);
+#endif
+    text.append(digits, end);
+}//writeDouble()
+
+
+
+inline void KeypointWriter::writeFloat(float value, int fixedDecimals, std::string& text) const
+{
+    if (!std::isfinite(value))
+    {
+        text += "null";
+        return;
+    }
+    static const double scales[] = { 1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    char digits[64];
+    char* end;
+    if (fixedDecimals >= 0 && fixedDecimals <= 9 && std::fabs(value) * scales[fixedDecimals] < 1e15)
+    {
+        //Rounded to an integer number of the smallest unit and written as integer digits, which is several times
+        //  faster than formatting a float (exact this far from the limits of a double, halves round away from zero)
+        long long scaled = std::llround(value * scales[fixedDecimals]);
+        end = digits;
+        if (scaled < 0)
+        {
+            *end++ = '-';
+            scaled = -scaled;
+        }
+        long long unit = (long long)scales[fixedDecimals];
+        char reversed[24];
+        int count = 0;
+        long long whole = scaled / unit;
+        do
+        {
+            reversed[count++] = (char)('0' + whole % 10);
+            whole /= 10;
+        } while (whole > 0);
+        while (count > 0)
+        {
+            *end++ = reversed[--count];
+        }
+        if (fixedDecimals > 0)
+        {
+            *end++ = '.';
+            long long fraction = scaled % unit;
+            for (int i = fixedDecimals - 1; i >= 0; i--)
+            {
+                end[i] = (char)('0' + fraction % 10);
+                fraction /= 10;
+            }
+            end += fixedDecimals;
+        }
+    }
+    else if (fixedDecimals >= 0)
+    {
+#if defined(__cpp_lib_to_chars)
+        end = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed, fixedDecimals).ptr;
+#else
+        end = digits + std::snprintf(digits, sizeof(digits), "%.*f", fixedDecimals, value);
+#endif
+    }
+    else
+    {
+#if defined(__cpp_lib_to_chars)
+        end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+#else
+        end = nlohmann::detail::to_chars(digits, digits + sizeof(digits), value);
+#endif
+    }
+    text.append(digits, end);
+}//writeFloat()
+
+
+
+inline void KeypointWriter::writeInteger(long long value, std::string& text) const
+{
+    char digits[32];
+#if defined(__cpp_lib_to_chars)
+    char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+#else
+    char* end = digits + std::snprintf(digits, sizeof(digits), "%lld", value);
+#endif
+    text.append(digits, end);
+}//writeInteger()
+
+
+
+inline void KeypointWriter::writeUnsigned(unsigned long long value, std::string& text) const
+{
+    char digits[32];
+#if defined(__cpp_lib_to_chars)
+    char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+#else
+    char* end = digits + std::snprintf(digits, sizeof(digits), "%llu", value);
+#endif
+    text.append(digits, end);
+}//writeUnsigned()
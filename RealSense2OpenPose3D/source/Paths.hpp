@@ -0,0 +1,27 @@
+//File paths for RealSense to OpenPose 3D
+//
+//Paths used to be put together with "\\", which on Linux names a file "dir\name" in the working directory instead of
+//  "name" inside dir. joinPath() puts the platform's separator between a directory and a file name instead.
+
+#pragma once
+
+#include <string>
+
+
+#if defined(_WIN32)
+const char PATH_SEPARATOR = '\\';
+#else
+const char PATH_SEPARATOR = '/';
+#endif
+
+
+
+//name inside directory. name has no leading separator, a trailing one on directory is fine.
+inline std::string joinPath(const std::string& directory, const std::string& name)
+{
+    if (directory.empty() || directory.back() == '\\' || directory.back() == '/')
+    {
+        return directory + name;
+    }
+    return directory + PATH_SEPARATOR + name;
+}//joinPath()
@@ -0,0 +1,278 @@
+//Pipeline stages for RealSense to OpenPose 3D
+//
+//Each keypoint file goes through capture -> registration -> fusion -> serialization -> output sinks. Every stage after
+//  registration runs on its own threads and takes its work from a BoundedQueue. A full queue blocks the stage feeding
+//  it (backpressure) instead of growing, so a slow disk ends up slowing down registration rather than using up memory.
+//Each stage counts what it did and where its time went: working, waiting for input (the stage before is the
+//  bottleneck), or blocked on a full output queue (a stage after is the bottleneck). The queues track how full they
+//  were whenever something was pushed.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+//Time a stage's threads spent in each state, plus the items it finished
+struct StageStats
+{
+    std::atomic<unsigned long long> items{ 0 };
+    std::atomic<unsigned long long> busyMicroseconds{ 0 };
+    std::atomic<unsigned long long> inputWaitMicroseconds{ 0 }; //Nothing to do
+    std::atomic<unsigned long long> outputWaitMicroseconds{ 0 }; //The next stage's queue was full
+};
+
+
+
+inline unsigned long long elapsedMicroseconds(std::chrono::steady_clock::time_point start)
+{
+    return (unsigned long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}//elapsedMicroseconds()
+
+
+
+template <class T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(int queueCapacity) : capacity(std::max(1, queueCapacity)), closed(false), pushes(0), occupancyTotal(0), mostQueued(0) {}
+
+    bool push(T item, std::atomic<unsigned long long>* waitMicroseconds = nullptr); //Blocks while full. False once closed.
+    bool pop(T& item, std::atomic<unsigned long long>* waitMicroseconds = nullptr); //Blocks while empty. False once closed and empty.
+    void close(); //Wakes everyone up, nothing more can be pushed
+
+    int size() const { return capacity; }
+    void occupancy(double& average, int& most) const; //How full the queue was at each push
+    void resetOccupancy();
+
+private:
+    const int capacity;
+    mutable std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::deque<T> items;
+    bool closed;
+    unsigned long long pushes;
+    unsigned long long occupancyTotal;
+    int mostQueued;
+};
+
+
+
+template <class T>
+inline bool BoundedQueue<T>::push(T item, std::atomic<unsigned long long>* waitMicroseconds)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if ((int)items.size() >= capacity && !closed)
+    {
+        auto waitStart = std::chrono::steady_clock::now();
+        notFull.wait(lock, [this] { return (int)items.size() < capacity || closed; });
+        if (waitMicroseconds != nullptr)
+        {
+            *waitMicroseconds += elapsedMicroseconds(waitStart);
+        }
+    }
+    if (closed)
+    {
+        return false;
+    }
+
+    items.push_back(std::move(item));
+    pushes++;
+    occupancyTotal += items.size();
+    mostQueued = std::max(mostQueued, (int)items.size());
+    lock.unlock();
+    notEmpty.notify_one();
+    return true;
+}//push()
+
+
+
+template <class T>
+inline bool BoundedQueue<T>::pop(T& item, std::atomic<unsigned long long>* waitMicroseconds)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (items.empty() && !closed)
+    {
+        auto waitStart = std::chrono::steady_clock::now();
+        notEmpty.wait(lock, [this] { return !items.empty() || closed; });
+        if (waitMicroseconds != nullptr)
+        {
+            *waitMicroseconds += elapsedMicroseconds(waitStart);
+        }
+    }
+    if (items.empty()) //Closed
+    {
+        return false;
+    }
+
+    item = std::move(items.front());
+    items.pop_front();
+    lock.unlock();
+    notFull.notify_one();
+    return true;
+}//pop()
+
+
+
+template <class T>
+inline void BoundedQueue<T>::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+    }
+    notEmpty.notify_all();
+    notFull.notify_all();
+}//close()
+
+
+
+template <class T>
+inline void BoundedQueue<T>::occupancy(double& average, int& most) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    average = pushes > 0 ? (double)occupancyTotal / pushes : 0.0;
+    most = mostQueued;
+}//occupancy()
+
+
+
+template <class T>
+inline void BoundedQueue<T>::resetOccupancy()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pushes = 0;
+    occupancyTotal = 0;
+    mostQueued = 0;
+}//resetOccupancy()
+
+
+
+//Starts the counters over, so each report only covers the time since the last one
+inline void resetStageStats(std::initializer_list<StageStats*> stages)
+{
+    for (StageStats* stats : stages)
+    {
+        stats->items = 0;
+        stats->busyMicroseconds = 0;
+        stats->inputWaitMicroseconds = 0;
+        stats->outputWaitMicroseconds = 0;
+    }
+}//resetStageStats()
+
+
+
+//A set of threads that take items from one queue, work on them, and pass them to the next queue (if there is one)
+template <class T>
+class PipelineStage
+{
+public:
+    PipelineStage(const std::string& stageName, int threadCount, BoundedQueue<T>& inputQueue, BoundedQueue<T>* outputQueue,
+        std::function<void(T&)> work);
+    ~PipelineStage() { join(); }
+
+    void join(); //Returns once the input queue has been closed and emptied
+    void resetStats() { resetStageStats({ &stats }); input.resetOccupancy(); }
+    void printStats(double seconds) const; //Throughput and where the time went over the last seconds, see resetStageStats()
+
+    const std::string name;
+    StageStats stats;
+
+private:
+    void run();
+
+    BoundedQueue<T>& input;
+    BoundedQueue<T>* output;
+    std::function<void(T&)> process;
+    std::vector<std::thread> threads;
+};
+
+
+
+template <class T>
+inline PipelineStage<T>::PipelineStage(const std::string& stageName, int threadCount, BoundedQueue<T>& inputQueue, BoundedQueue<T>* outputQueue,
+    std::function<void(T&)> work)
+    : name(stageName), input(inputQueue), output(outputQueue), process(work)
+{
+    for (int i = 0; i < std::max(1, threadCount); i++)
+    {
+        threads.emplace_back(&PipelineStage::run, this);
+    }
+}//PipelineStage()
+
+
+
+template <class T>
+inline void PipelineStage<T>::join()
+{
+    for (std::thread& thread : threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+}//join()
+
+
+
+template <class T>
+inline void PipelineStage<T>::run()
+{
+    T item;
+    while (input.pop(item, &stats.inputWaitMicroseconds))
+    {
+        auto workStart = std::chrono::steady_clock::now();
+        process(item);
+        stats.busyMicroseconds += elapsedMicroseconds(workStart);
+        stats.items++;
+
+        if (output != nullptr && !output->push(std::move(item), &stats.outputWaitMicroseconds))
+        {
+            return; //Shutting down
+        }
+    }
+}//run()
+
+
+
+//Prints one stage's counters. seconds is the wall time they were collected over, so the shares add up to 100% per thread.
+inline void printStageStats(const std::string& name, const StageStats& stats, int threadCount, double seconds, double queueAverage, int queueMost, int queueSize)
+{
+    double threadMicroseconds = std::max(1.0, seconds * 1e6 * threadCount);
+    std::ostringstream line; //Its own formatting, so std::cout's precision is left alone
+    line << std::fixed << std::setprecision(1) << name << ": " << stats.items.load() << " items (" << stats.items.load() / std::max(seconds, 1e-3)
+        << "/s) on " << threadCount << " thread(s), busy " << 100.0 * stats.busyMicroseconds.load() / threadMicroseconds
+        << "%, waiting for input " << 100.0 * stats.inputWaitMicroseconds.load() / threadMicroseconds
+        << "%, blocked on output " << 100.0 * stats.outputWaitMicroseconds.load() / threadMicroseconds << "%";
+    if (queueSize > 0)
+    {
+        line << ", input queue " << queueAverage << " average / " << queueMost << " most of " << queueSize;
+    }
+    line << "\n";
+    std::cout << line.str();
+}//printStageStats()
+
+
+
+template <class T>
+inline void PipelineStage<T>::printStats(double seconds) const
+{
+    double average;
+    int most;
+    input.occupancy(average, most);
+    printStageStats(name, stats, (int)threads.size(), seconds, average, most, input.size());
+}//printStats()
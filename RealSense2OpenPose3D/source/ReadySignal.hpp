@@ -0,0 +1,81 @@
+//Readiness signal for RealSense to OpenPose 3D
+//
+//The program that starts RS2OP3D.exe (launch.py) listens on a loopback TCP port and passes it as ready=<port>. As soon
+//  as the color sensor is free for OpenPose, sendReadySignal() connects to that port and sends one line of JSON with
+//  the startup timing breakdown, so the launcher wakes up the instant it can start OpenPose instead of sleeping and
+//  polling ready.txt. Loopback TCP is used because Python has it on every platform (it has no Unix domain sockets on
+//  Windows and named pipes would need pywin32). ready.txt is still written for anything else watching it.
+
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX //Keep std::min and std::max usable
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+
+//Sends message (one line) to the launcher listening on 127.0.0.1:port. False if nobody was listening.
+inline bool sendReadySignal(int port, const std::string& message)
+{
+#if defined(_WIN32)
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    {
+        return false;
+    }
+    SOCKET connection = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    bool opened = connection != INVALID_SOCKET;
+#else
+    int connection = socket(AF_INET, SOCK_STREAM, 0);
+    bool opened = connection >= 0;
+#endif
+
+    bool sent = false;
+    if (opened)
+    {
+        sockaddr_in launcher = {};
+        launcher.sin_family = AF_INET;
+        launcher.sin_port = htons((unsigned short)port);
+        launcher.sin_addr.s_addr = htonl(INADDR_LOOPBACK); //Never leaves the machine
+
+        if (connect(connection, (const sockaddr*)&launcher, sizeof(launcher)) == 0)
+        {
+            std::string line = message + "\n";
+            sent = send(connection, line.data(), (int)line.size(), 0) == (int)line.size();
+        }
+    }
+
+#if defined(_WIN32)
+    if (opened)
+    {
+        closesocket(connection);
+    }
+    WSACleanup();
+#else
+    if (opened)
+    {
+        close(connection);
+    }
+#endif
+
+    if (!sent)
+    {
+        std::cout << "Could not send the ready signal to port " << port << ", the launcher will have to find ready.txt.\n";
+    }
+    return sent;
+}//sendReadySignal()
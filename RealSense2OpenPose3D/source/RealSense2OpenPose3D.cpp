@@ -10,22 +10,30 @@
 
 /*
 Program Outline:
-    1. Parse command line arguments to control the OpenPose output folder path
+    1. Parse command line arguments to control the OpenPose output folder path and which cameras to use
+       (each camera below has its own copy of steps 2 to 8, see CameraContext)
     2. Start a normal stream and wait a handful of frames for the cameras to stabilize
-    3. Save a color frame from that normal stream
+    3. Save the camera intrinsics and extrinsics from that normal stream (and a color frame for align=sdk)
     4. Stop that normal stream
     5. Start a new stream with the color sensor disabled
     6. Signal that the color camera is free to use
         a. OpenPose should be started now
-    7. Start a virtual device stream
-    8. On every frame, save the depth frame and inject it and the color frame into the virtual device
-    9. Align the frameset in the virtual device
-    10. Check the OpenPose output folder for any new frames (or the first frame)
+    7. On every frame, the capture thread copies the depth frame and its timestamps into a pooled buffer and queues it for
+       the main (registration) thread, which keeps the last few in a ring (see CaptureQueue.hpp and DepthRingBuffer.hpp).
+       With handoff=latest it only publishes the newest frame instead (see TripleBuffer.hpp)
+        a. (align=sdk only) Inject it and the color frame into a virtual device and align the frameset there
+    8. Registration: check the OpenPose output folder for any new frames (or the first frame) that OpenPose has finished writing (see FileWatcher.hpp)
         a. If there is a new frame, load the JSON file
-        b. Read through the JSON file to get all the points that OpenPose found
-        c. For each point, add the depth information for that pixel from the latest aligned depth frame
-        d. Save the JSON file
-        e. Remember that this file was already updated so ignore it next time
+        b. Pick the saved depth frame taken closest to OpenPose's color image (file write time minus delay=)
+        c. (align=full only) Align it to the color image with DepthAligner
+        d. Read through the JSON file to get all the points that OpenPose found
+        e. For each point, find the depth pixel behind it in that depth frame (see Registration.hpp)
+        f. Remember that this file was already handled so ignore it next time
+        g. Repeat for every other finished file so the program never falls behind OpenPose
+    9. Fusion, serialization, and output each run on their own threads behind a bounded queue (see Pipeline.hpp)
+        a. Fusion deprojects the points and adds them to the JSON
+        b. Serialization turns the JSON back into text
+        c. Output saves the file
 */
 
 #define _CRT_SECURE_NO_WARNINGS //Allows the use of std::strtok()
@@ -39,16 +47,122 @@ Program Outline:
 #include <librealsense2/hpp/rs_internal.hpp>
 
 #include <chrono>
+#include <atomic>
+#include <thread>
 
 
 #include "./json.hpp" //Send some thanks this way -> https://github.com/nlohmann/json
 using json = nlohmann::json;
 
+#include "./Registration.hpp" //Keypoint-only depth registration
+#include "./Alignment.hpp" //Full frame depth registration
+#include "./Stats.hpp" //Per-frame timing
+#include "./FileWatcher.hpp" //New OpenPose output files
+#include "./DepthRingBuffer.hpp" //Recent depth frames with their timestamps
+#include "./CaptureQueue.hpp" //Capture thread to fusion thread
+#include "./TripleBuffer.hpp" //Newest depth frame only
+#include "./Pipeline.hpp" //Registration, fusion, serialization, and output stages
+#include "./WorldFusion.hpp" //All cameras' people in one world frame
+#include "./CalibrationCache.hpp" //Camera values without the warm-up capture
+#include "./WarmUp.hpp" //When auto-exposure has settled
+#include "./ReadySignal.hpp" //Tell the launcher the color sensor is free
+#include "./KeypointReader.hpp" //Keypoint arrays without a DOM
+#include "./KeypointWriter.hpp" //Compact output
+#include "./Benchmark.hpp" //benchmark=true
+#include "./BinaryKeypoints.hpp" //output=binary
+
+//Everything that belongs to one RealSense device: its calibration, registration, capture thread, and OpenPose output.
+//  The fusion, serialization, and output stages are shared by all of them.
+struct CameraContext
+{
+    std::string serial; //Device serial number, empty for the first device found
+    std::string bagFile; //Recorded .bag file to replay instead of a live camera
+    std::string outputPath; //OpenPose output directory for this camera
+    std::string name; //For messages
+    std::string poseName; //Serial number or recording, as named in the camera pose file
+    int index; //Position in cameras, the first one is the world fusion reference
+
+    //Initial frame and camera information
+    rs2_intrinsics colorIntrinsics;
+    rs2_intrinsics depthIntrinsics;
+    rs2_extrinsics depth2ColorExtrinsics;
+    float depthScale = 0.001f; //Meters per depth unit
+    rs2::frame baselineColorFrame; //Only kept when rs2::align needs it (align=sdk or verify=true)
+    std::string calibrationSource; //Where loadCameraValues() got the values from
+    double calibrationMs = 0; //How long that took
+
+    //Registration
+    DepthRayTable* depthRays = nullptr; //Deprojection of every depth pixel, built once after the baseline
+    SparseRegistration* sparseRegistration = nullptr;
+    ColorRayTable* colorRays = nullptr; //Undistorted color pixel rays for deprojecting the keypoints
+    DepthAligner* depthAligner = nullptr;
+    SdkAligner* sdkAligner = nullptr; //The original software device method (see Alignment.hpp)
+    std::vector<uint16_t> alignedDepth; //Z16 depth in color image space (align=full)
+    unsigned long long alignedFrameNumber = ~0ULL; //Depth frame currently in alignedDepth
+    rs2::depth_frame depthAligned = rs2::frame(); //align=sdk only, the newest depth frame aligned by rs2::align
+
+    //Capture
+    rs2::pipeline pipe;
+    std::thread captureThread;
+    CaptureQueue* captureQueue = nullptr; //Depth frames from the capture thread to the registration (main) thread
+    DepthTripleBuffer* latestDepth = nullptr;
+    DepthRingBuffer* depthRing = nullptr; //Depth frames kept for matching to keypoint files
+
+    KeypointFileWatcher* keypointWatcher = nullptr;
+    int frameNumber = 0; //Corresponds to the file name to be read from OpenPose
+};
+
+//One keypoint file on its way through the pipeline (see Pipeline.hpp)
+struct KeypointJob
+{
+    CameraContext* camera;
+    std::string fileName;
+    int frameNumber; //OpenPose's frame, the number in fileName
+    std::chrono::system_clock::time_point written; //When OpenPose wrote the file
+    double imageTimeMs; //Estimated time the color image was taken, for world fusion
+    std::chrono::steady_clock::time_point started; //When registration picked it up
+    std::string source; //The file as OpenPose wrote it
+    KeypointFile keypoints; //Its 2D keypoints, read by registration
+    json document; //The whole file with its 3D keypoints, only made if it is written with splice=false or world fusion needs it
+    KeypointBatch batch; //Every keypoint of every person
+    std::vector<size_t> personStart; //Each person's first keypoint in batch, then the total
+    std::vector<float> points; //x, y, z, confidence of every keypoint in batch, filled in by fusion
+    std::string text; //Serialized output
+    std::string binary; //Serialized output with output=binary or both
+};
+
 //Functions
 bool checkCmdLine(int argNumber, char** argStrings); //Parse the command line arguments
-void getBaselineFrameAndCameraValues(); //Save the camera parameters and one color frame
-void setReady(); //Set the "ready" text file to tell the rest of the programs that this program is ready 
-void updateKeypoints(const rs2::depth_frame* depth, int& frameNumber); //Inject depth info into output files
+bool addCamera(const std::string& device, const std::string& outputPath); //A camera from camera= or the default arguments
+bool prepareOutputDirectory(const std::string& outputPath); //Make sure the directory can be written and set "ready" to false
+void startCamera(CameraContext& camera); //Build the camera's tables and start its capture thread
+void captureLoop(CameraContext* camera); //Capture thread: queue every depth frame for the registration thread
+void loadCameraValues(CameraContext& camera); //Camera parameters from the cache, the device, or the warm-up capture
+void getBaselineFrameAndCameraValues(CameraContext& camera); //Save the camera parameters and one color frame
+void setReady(const std::string& outputPath); //Set the "ready" text file to tell the rest of the programs that this program is ready 
+void reportStartup(double argumentsMs, double totalMs); //Print where the startup time went and send it with the ready signal
+std::string keypointFileName(int frameNumber); //OpenPose's file name for a frame
+int countWaitingFiles(const CameraContext& camera); //Keypoint files OpenPose has written that registration hasn't picked up yet
+int registerNewFiles(CameraContext& camera, BoundedQueue<KeypointJob*>& freeJobs, BoundedQueue<KeypointJob*>& fusionQueue, StageStats& stats); //Registration of one camera
+const uint16_t* prepareDepth(CameraContext& camera, const DepthSlot& depth); //Align the depth frame if the registration mode needs it
+bool loadKeypoints(KeypointJob& job); //Registration: read OpenPose's file
+void findKeypointDepths(KeypointJob& job, const uint16_t* depthData); //Registration: depth behind each keypoint
+void fuseKeypoints(KeypointJob& job); //Fusion: add the 3D keypoints
+void fusePerson(const KeypointFile& keypoints, size_t personIndex, const KeypointBatch& batch, size_t firstKeypoint, std::vector<float>& points); //Fusion of one person, may run on any pool thread
+void addPoints(const KeypointJob& job, json& people); //Fusion: the 3D keypoints as *_keypoints_3d arrays
+void serializeKeypoints(KeypointJob& job); //Serialization: the file with its 3D keypoints as text
+void writeKeypoints(KeypointJob& job); //Output: save the file with depth
+void fuseWorld(KeypointJob& job); //World fusion: add the file to the world frame
+void writeWorldFrame(const json& fused); //Save a world frame
+bool runOfflineWorldFusion(); //World fusion of recorded *_keypointsD files
+void binaryToJson(const BinaryKeypointFrame& binary, json& document); //A binary keypoint file's people for WorldFusion
+double toMilliseconds(std::chrono::system_clock::time_point time); //Since 1970
+float getKeypointDepth(const CameraContext& camera, const uint16_t* depthData, const float pixel[2]); //Depth in meters behind a color pixel
+void checkAlignment(const CameraContext& camera, const rs2::depth_frame& sdkAligned); //Compare the full frame alignment with rs2::align
+rs2::pipeline_profile startReplay(rs2::pipeline& pipe, const std::string& bagFile); //Play a recording once, every frame
+bool runAlignmentReplay(); //verify=replay: false if any aligned pixel of a recording differs from rs2::align
+bool runRegistrationBenchmark(); //benchmark=replay: time rs2::align against sparse registration on a recording
+bool isTrue(const std::string& value); //Parse a true/false command line value
 int f2i(double x); //Round floats to nearest integers
 void press2Close(); //Simple wait for user input to close the program
 
@@ -59,114 +173,338 @@ int colorHeight = 1080;
 
 const rs2::vertex* depthVertices = nullptr; //Array of vertecies, one vertex for every pixel
 
-//Initial frame and camera information
-rs2_intrinsics colorIntrinsics;
-rs2_intrinsics depthIntrinsics;
-rs2_extrinsics depth2ColorExtrinsics;
-rs2::frame baselineColorFrame;
+std::vector<CameraContext*> cameras; //Every device this process handles
 
-std::string OpenPoseOutPath("..\\openPoseOutput"); //Default OpenPose output directory path
+//How the depth is matched to the keypoints
+enum RegistrationMode
+{
+    REGISTRATION_SPARSE, //Only the keypoint pixels are looked up in the raw depth frame (default)
+    REGISTRATION_FULL, //The whole depth frame is aligned to the color image with DepthAligner
+    REGISTRATION_SDK //The whole depth frame is aligned to the baseline color frame with rs2::align
+};
+RegistrationMode registrationMode = REGISTRATION_SPARSE;
+int colorTableStep = 4; //Color pixels between the color ray table's grid points, 0 deprojects with the distortion model instead
+bool verifyAlignment = false; //Run rs2::align next to DepthAligner and report any difference
+bool verifyReplay = false; //Only check every DepthAligner path against rs2::align on a whole recording (bag=), no OpenPose
+int alignThreads = 1; //Threads used by DepthAligner (align=full)
+int warmUpMaxFrames = 90; //Longest warm-up, it ends as soon as exposure and gain settle
+const int WARM_UP_FIXED_FRAMES = 30; //Without exposure metadata, throw out the first ~1 sec of frames (30FPS * 30 = 1sec)
+std::string calibrationDirectory("."); //Where camera values are cached, empty always uses the warm-up capture
+int readyPort = 0; //Loopback port the launcher waits on for the ready signal, 0 only writes ready.txt
+WorkerPool* workerPool = nullptr; //Shared by every camera, registration runs on one thread
+
+std::string bagFile; //Recorded .bag file to replay instead of a live camera, when there are no camera= arguments
+bool printStats = false; //Print per-frame latency
+bool watchEvents = true; //Learn about new OpenPose files from the OS instead of trying to open the next one every frame
+bool catchUp = true; //Handle every finished keypoint file each depth frame instead of just the next one
+int historyFrames = 10; //Depth frames kept for matching to keypoint files
+double pipelineDelayMs = 0; //Time from the color image being taken to OpenPose writing its keypoint file
+
+int queueFrames = 4; //Depth frames that may wait for the registration thread
+DropPolicy dropPolicy = DROP_OLDEST; //What the capture thread does when the registration thread falls behind
+bool latestOnly = false; //Hand over only the newest depth frame (DepthTripleBuffer) instead of queueing every one
+std::atomic<bool> capturing(true);
+
+std::string OpenPoseOutPath("..\\openPoseOutput"); //Default OpenPose output directory path, used when there are no camera= arguments
+
+
+int stageQueueSize = 4; //Keypoint files that may wait in front of each stage
+int fusionThreads = 1;
+int serializeThreads = 1;
+int sinkThreads = 1;
+int personThreads = 1; //Threads splitting the people of one keypoint file during fusion
+int personCutoff = 8; //Files with fewer people are fused on the fusion thread alone
+WorkerPool* personPool = nullptr;
+LatencyStats fileLatencyStats("Keypoint file latency"); //From registration picking up a file to its depth version being written
+LatencyStats fileLagStats("Keypoint file lag"); //From OpenPose writing a file to this program writing its depth version
+LatencyStats fileSizeStats("Keypoint file size", 300, "bytes"); //Size of each depth version
+std::string worldPoseFile; //Camera to world extrinsics, world fusion is on when there is one
+std::string worldOutputPath; //Where world frames are written, defaults to the first camera's output directory
+double worldWindowMs = 50; //How far apart in time views fused into one world frame may be
+bool offlineWorld = false; //Only fuse recorded files, no cameras
+bool runBenchmark = false; //Only time reading and writing keypoint files (see Benchmark.hpp), no cameras
+bool benchmarkReplay = false; //Only time the registration modes on a recording (bag=), no OpenPose
+int outputDecimals = -1; //Digits after the decimal point of written 3D coordinates, -1 for all a float needs
+bool spliceOutput = true; //Copy OpenPose's text and splice in the 3D arrays instead of parsing and rewriting the whole file
+bool writeJson = true; //Write ############_keypointsD.json
+bool writeBinary = false; //Write ############_keypointsD.bin (see BinaryKeypoints.hpp)
+WorldFusion* worldFusion = nullptr;
+int worldFrameNumber = 0;
+LatencyStats matchGapStats("Keypoint to depth capture gap"); //How far the matched depth frame was from the estimated image time
 
 int main(int argc, char* argv[])
 {
+    auto startupStart = std::chrono::steady_clock::now();
     if (checkCmdLine(argc, argv) != true) //If user defined OpenPose output dir path provided, use that, otherwise default path
     {
         press2Close();
         return -1; //Something was wrong that required the program to exit
     }
+    if (runBenchmark)
+    {
+        if (benchmarkReplay)
+        {
+            return runRegistrationBenchmark() ? 0 : 1;
+        }
+        runKeypointBenchmark();
+        return 0;
+    }
+    if (verifyReplay)
+    {
+        return runAlignmentReplay() ? 0 : 1;
+    }
 
-    getBaselineFrameAndCameraValues(); //Run the sensor briefly to collect the intrinsics, exrinsics, and a baseline color frame
-    setReady();
+    if (!worldPoseFile.empty())
+    {
+        std::vector<std::string> poseNames;
+        for (CameraContext* camera : cameras)
+        {
+            poseNames.push_back(camera->poseName);
+        }
+        std::vector<rs2_extrinsics> poses;
+        if (!loadCameraPoses(worldPoseFile, poseNames, poses))
+        {
+            press2Close();
+            return -1;
+        }
+        worldFusion = new WorldFusion(poses, worldWindowMs);
+        if (worldOutputPath.empty())
+        {
+            worldOutputPath = cameras[0]->outputPath;
+        }
+        std::cout << "World frames of " << cameras.size() << " camera(s) will be written to \"" << worldOutputPath << "\"\n";
+    }
+    if (offlineWorld)
+    {
+        return runOfflineWorldFusion() ? 0 : -1;
+    }
+    double argumentsMs = elapsedMs(startupStart, std::chrono::steady_clock::now());
 
+    for (CameraContext* camera : cameras) //Collect the intrinsics, exrinsics, and if needed a baseline color frame
+    {
+        loadCameraValues(*camera);
+    }
+    for (CameraContext* camera : cameras)
+    {
+        setReady(camera->outputPath);
+    }
+    reportStartup(argumentsMs, elapsedMs(startupStart, std::chrono::steady_clock::now())); //The color sensors are free from here on
 
-    //Create a new pipeline to stream the depth data
-    rs2::pipeline pipe; //Create a pipeline
-    rs2::config cfg; //Set up the configuration of the camera
-    cfg.enable_stream(RS2_STREAM_DEPTH, depthWidth, depthHeight, RS2_FORMAT_Z16, 30); //Full resolution and FPS so depth is always up-to-date
-    cfg.disable_stream(RS2_STREAM_COLOR); //Note that the color stream is DISABLED so it can be opened by OpenPose
-    pipe.start(cfg);
+    if (registrationMode == REGISTRATION_FULL)
+    {
+        workerPool = new WorkerPool(alignThreads);
+    }
+    for (CameraContext* camera : cameras) //Stage 1: capture, one thread per camera
+    {
+        startCamera(*camera);
+    }
+
+    //Every keypoint file in flight has a job from this pool, so the stages never allocate one
+    std::vector<KeypointJob> jobs(3 * stageQueueSize + fusionThreads + serializeThreads + sinkThreads + 1);
+    BoundedQueue<KeypointJob*> freeJobs((int)jobs.size());
+    for (KeypointJob& job : jobs)
+    {
+        freeJobs.push(&job);
+    }
 
+    //Stages 3 to 5 are shared by every camera, stage 2 (registration) is this thread
+    if (personThreads > 1)
+    {
+        personPool = new WorkerPool(personThreads);
+        std::cout << "Fusion splits files with at least " << personCutoff << " people across " << personThreads << " threads\n";
+    }
+    BoundedQueue<KeypointJob*> fusionQueue(stageQueueSize);
+    BoundedQueue<KeypointJob*> worldQueue(stageQueueSize);
+    BoundedQueue<KeypointJob*> serializeQueue(stageQueueSize);
+    BoundedQueue<KeypointJob*> sinkQueue(stageQueueSize);
+    PipelineStage<KeypointJob*> fusionStage("Fusion", fusionThreads, fusionQueue, worldFusion != nullptr ? &worldQueue : &serializeQueue, [](KeypointJob*& job) { fuseKeypoints(*job); });
+    PipelineStage<KeypointJob*>* worldStage = nullptr; //One thread, it keeps every camera's latest view
+    if (worldFusion != nullptr)
+    {
+        worldStage = new PipelineStage<KeypointJob*>("World fusion", 1, worldQueue, &serializeQueue, [](KeypointJob*& job) { fuseWorld(*job); });
+    }
+    PipelineStage<KeypointJob*> serializeStage("Serialization", serializeThreads, serializeQueue, &sinkQueue, [](KeypointJob*& job) { serializeKeypoints(*job); });
+    PipelineStage<KeypointJob*> sinkStage("Output", sinkThreads, sinkQueue, &freeJobs, [](KeypointJob*& job) { writeKeypoints(*job); }); //Done jobs go back to the pool
+    StageStats registrationStats;
 
-    // Create software device to allow for merging of old color image frame and current depth frame: Frame Reconstruction
-    rs2::software_device dev;
+    LatencyStats filesPerFrameStats("Keypoint files per depth frame", 300, "files");
+    LatencyStats waitingFileStats("Keypoint files still waiting", 300, "files"); //Finished files left after each depth frame (the backlog)
+    auto statsStart = std::chrono::steady_clock::now();
 
-    auto depth_sensor = dev.add_sensor("Depth"); // New virtual sensors
-    auto color_sensor = dev.add_sensor("Color");
+    std::cout << "Starting Main frame injection loop...\n";
 
-    //Add video streams to the virtual sensors so that they can be interacted with
-    auto depth_stream = depth_sensor.add_video_stream(
-        { RS2_STREAM_DEPTH, 0, 0, depthWidth, depthHeight, 30, 2, RS2_FORMAT_Z16,
-         depthIntrinsics });
-    auto color_stream = color_sensor.add_video_stream(
-        { RS2_STREAM_COLOR, 0, 1, colorWidth, colorHeight, 30, 3, RS2_FORMAT_BGR8,
-         colorIntrinsics });
+    //Forever
+    while (true)
+    {
+        //Register the new keypoint files of every camera that has a new depth frame
+        auto waitStart = std::chrono::steady_clock::now();
+        bool newDepth = false;
+        for (CameraContext* camera : cameras)
+        {
+            int filesDone = registerNewFiles(*camera, freeJobs, fusionQueue, registrationStats);
+            if (filesDone < 0) //No new depth frame
+            {
+                continue;
+            }
+            newDepth = true;
+            if (printStats)
+            {
+                filesPerFrameStats.add(filesDone);
+                waitingFileStats.add(countWaitingFiles(*camera));
+            }
+        }
+        if (!newDepth) //Nothing new, the depth frame rate paces this loop
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            registrationStats.inputWaitMicroseconds += elapsedMicroseconds(waitStart);
+            continue;
+        }
 
-    //Set read only option to fix issue of only adding one of the two frames. Note the depth units constant
-    depth_sensor.add_read_only_option(RS2_OPTION_DEPTH_UNITS, 0.001f);
-    depth_sensor.add_read_only_option(RS2_OPTION_STEREO_BASELINE, 0.001f);
+        if (printStats)
+        {
+            double seconds = elapsedMs(statsStart, std::chrono::steady_clock::now()) / 1000.0;
+            if (seconds >= 10) //Every stage's counters since the last report
+            {
+                for (CameraContext* camera : cameras)
+                {
+                    std::cout << camera->name << " ";
+                    if (latestOnly)
+                    {
+                        camera->latestDepth->printCounters();
+                    }
+                    else
+                    {
+                        camera->captureQueue->printCounters();
+                    }
+                }
+                printStageStats("Registration", registrationStats, 1, seconds, 0, 0, 0);
+                fusionStage.printStats(seconds);
+                if (worldStage != nullptr)
+                {
+                    worldStage->printStats(seconds);
+                }
+                serializeStage.printStats(seconds);
+                sinkStage.printStats(seconds);
+                statsStart = std::chrono::steady_clock::now();
+                resetStageStats({ &registrationStats });
+                fusionStage.resetStats();
+                if (worldStage != nullptr)
+                {
+                    worldStage->resetStats();
+                }
+                serializeStage.resetStats();
+                sinkStage.resetStats();
+            }
+        }
+    }//forever
 
-    depth_stream.register_extrinsics_to(color_stream, depth2ColorExtrinsics); // Add camera extrinsics
+    //Let everything in flight finish, stage by stage
+    fusionQueue.close();
+    fusionStage.join();
+    worldQueue.close();
+    if (worldStage != nullptr)
+    {
+        worldStage->join();
+        if (worldFusion->lateViews() > 0)
+        {
+            std::cout << worldFusion->lateViews() << " keypoint files reached world fusion after a newer one of their camera and were left out\n";
+        }
+    }
+    serializeQueue.close();
+    serializeStage.join();
+    sinkQueue.close();
+    sinkStage.join();
 
-    // Create the syncer that matches timestamps of both frames
-    dev.create_matcher(RS2_MATCHER_DEFAULT);
-    rs2::syncer sync;
+    capturing = false;
+    for (CameraContext* camera : cameras)
+    {
+        if (camera->captureQueue != nullptr)
+        {
+            camera->captureQueue->stop();
+        }
+        camera->captureThread.join();
+    }
+    return 0;
+}//main()
 
-    depth_sensor.open(depth_stream);
-    color_sensor.open(color_stream);
 
-    depth_sensor.start(sync);
-    color_sensor.start(sync);
 
-    rs2::align align(RS2_STREAM_COLOR); // Prepare to align the depth frames to color frames
+//Builds a camera's registration tables from its baseline values, starts its depth only stream, and starts its capture thread
+void startCamera(CameraContext& camera)
+{
+    std::cout << camera.name << ":\n";
+    camera.depthRays = new DepthRayTable(camera.depthIntrinsics, camera.depth2ColorExtrinsics); //The camera values are fixed from here on
+    std::cout << "Depth ray table: " << camera.depthRays->memoryBytes() / (1024 * 1024) << " MB\n";
+    camera.sparseRegistration = new SparseRegistration(*camera.depthRays, camera.depthIntrinsics, camera.colorIntrinsics, camera.depth2ColorExtrinsics, camera.depthScale);
+    if (colorTableStep > 0)
+    {
+        camera.colorRays = new ColorRayTable(camera.colorIntrinsics, colorTableStep);
+        std::cout << "Color ray table: " << camera.colorRays->memoryBytes() / 1024 << " KB, max error " << camera.colorRays->maxErrorPixels() << " pixels\n";
+    }
 
-    rs2::frameset fsAligned; // Declare a frameset and depth frame to hold onto the frames that we want to collect from the virtual device
-    rs2::frame depthAligned;
+    //Create a new pipeline to stream the depth data
+    rs2::config cfg; //Set up the configuration of the camera
+    if (!camera.bagFile.empty())
+    {
+        cfg.enable_device_from_file(camera.bagFile); //Replay a recording instead of using the camera
+    }
+    else if (!camera.serial.empty())
+    {
+        cfg.enable_device(camera.serial);
+    }
+    cfg.enable_stream(RS2_STREAM_DEPTH, depthWidth, depthHeight, RS2_FORMAT_Z16, 30); //Full resolution and FPS so depth is always up-to-date
+    cfg.disable_stream(RS2_STREAM_COLOR); //Note that the color stream is DISABLED so it can be opened by OpenPose
+    camera.pipe.start(cfg);
 
-    //Save some info about the actual video/depth frames
-    void* colorPx = (void*)baselineColorFrame.get_data();
-    int colorStride = ((rs2::video_frame)baselineColorFrame).get_stride_in_bytes();
-    int colorBPP = ((rs2::video_frame)baselineColorFrame).get_bytes_per_pixel();
+    if (registrationMode == REGISTRATION_SDK || verifyAlignment)
+    {
+        camera.sdkAligner = new SdkAligner(camera.depthIntrinsics, camera.colorIntrinsics, camera.depth2ColorExtrinsics, camera.depthScale, camera.baselineColorFrame);
+    }
 
-    int idx = 0; //A frame number used internally by the syncer
-    int frameNumber = 0; //Corresponds to the file name to be read from OpenPose
+    if (registrationMode == REGISTRATION_FULL)
+    {
+        camera.depthAligner = new DepthAligner(camera.depthIntrinsics, camera.colorIntrinsics, camera.depth2ColorExtrinsics, camera.depthScale);
+        camera.alignedDepth.resize((size_t)camera.colorIntrinsics.width * camera.colorIntrinsics.height);
+        std::cout << "Full frame alignment using " << alignPathNames[camera.depthAligner->path()] << " on " << alignThreads << " thread(s)\n";
+    }
 
-    std::cout << "Starting Main frame injection loop...\n";
+    camera.keypointWatcher = new KeypointFileWatcher(camera.outputPath, watchEvents);
 
-    //Forever
-    while (true)
+    int ringFrames = registrationMode == REGISTRATION_SDK ? 1 : historyFrames; //align=sdk only uses the newest frame
+    camera.depthRing = new DepthRingBuffer(ringFrames);
+    if (latestOnly)
+    {
+        camera.latestDepth = new DepthTripleBuffer(depthWidth, depthHeight);
+        std::cout << "Depth triple buffer: " << camera.latestDepth->memoryBytes() / (1024 * 1024) << " MB, only the newest depth frame is used\n";
+    }
+    else
     {
-        //Wait for a depth frame and then save it to "depth"
-        rs2::frameset frameset = pipe.wait_for_frames();
-        auto depth = frameset.get_depth_frame();
+        camera.captureQueue = new CaptureQueue(queueFrames, ringFrames, depthWidth, depthHeight, dropPolicy);
+        std::cout << "Depth frame pool: " << camera.captureQueue->memoryBytes() / (1024 * 1024) << " MB for " << ringFrames << " kept and "
+            << queueFrames << " queued frames, " << (dropPolicy == DROP_OLDEST ? "dropping the oldest" : "blocking") << " when full\n";
+    }
+    camera.captureThread = std::thread(captureLoop, &camera);
+}//startCamera()
 
 
-        color_sensor.on_video_frame({ colorPx, // Frame pixels from baseline color capture
-                                     [](void*) {}, // Custom deleter (if required)
-                                     colorStride, colorBPP, // Stride and Bytes-per-pixel
-                                     depth.get_timestamp(), RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME,
-                                     idx, // Timestamp, Frame# for potential sync services
-                                     color_stream });
-        depth_sensor.on_video_frame({ (void*)depth.get_data(), // Frame pixels from capture API
-                                     [](void*) {}, // Custom deleter (if required)
-                                     depth.get_stride_in_bytes(), depth.get_bytes_per_pixel(), // Stride and Bytes-per-pixel
-                                     depth.get_timestamp(), RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME,
-                                     idx, // Timestamp, Frame# for potential sync services
-                                     depth_stream });
 
-        
-        fsAligned = sync.wait_for_frames();
-        if (fsAligned.size() == 2) //If both a color and depth frame are ready
+//Stage 1: waits for a camera's depth frames and queues a copy of each one for the registration thread, so nothing the
+//  later stages do (alignment, parsing, disk writes) can make the program miss camera frames
+void captureLoop(CameraContext* camera)
+{
+    while (capturing)
+    {
+        rs2::frameset frameset = camera->pipe.wait_for_frames();
+        if (latestOnly)
         {
-            fsAligned = align.process(fsAligned); //Align the depth to the color frame
-            rs2::depth_frame depthAligned = fsAligned.get_depth_frame(); //Get the aligned depth frame
-
-            updateKeypoints(&depthAligned, frameNumber); //Add the depth information to any new files generated
+            camera->latestDepth->publish(frameset.get_depth_frame(), std::chrono::system_clock::now()); //Never waits
         }
-        idx++;
-    }//forever
-
-    return 0;
-}//main()
+        else
+        {
+            camera->captureQueue->push(frameset.get_depth_frame(), std::chrono::system_clock::now());
+        }
+    }
+}//captureLoop()
 
 
 
@@ -174,13 +512,21 @@ int main(int argc, char* argv[])
 //  If there are any problems, the default OpenPose output directory is kept.
 bool checkCmdLine(int argNum, char** argStrings)
 {
-    char expected[] = "Expected input: .\\RealSense2OpenPose3D.exe \"path\\to\\openpose\\output\\directory\" \"<width>x<height>\"\n";
+    char expected[] = "Expected input: .\\RealSense2OpenPose3D.exe \"path\\to\\openpose\\output\\directory\" \"<width>x<height>\" [align=<sparse/full/sdk>] [verify=<true/false/replay>] [threads=<number>] [bag=<path\\to\\recording.bag>] [stats=<true/false>] [lut=<pixels>] [watch=<events/poll>] [catchup=<true/false>] [history=<frames>] [delay=<ms>] [queue=<frames>] [drop=<oldest/block>] [handoff=<queue/latest>] [stagequeue=<files>] [fusion=<threads>] [serialize=<threads>] [sinks=<threads>] [personthreads=<number>] [personcutoff=<people>] [camera=<serial or path\\to\\recording.bag>,<path\\to\\openpose\\output\\directory> ...] [world=<path\\to\\camera\\poses.json>] [worldout=<path\\to\\world\\directory>] [window=<ms>] [offline=<true/false>] [calibration=<path\\to\\cache\\directory/off>] [warmup=<frames>] [ready=<port>] [benchmark=<true/false/replay>] [precision=<decimals>] [splice=<true/false>] [output=<json/binary/both>]\n";
     char defaultPath[] = "Using the default OpenPose output directory path.\n";
     char outWillBe[] = "The OpenPose output directory will be \"";
 
     if (argNum > 1) //There are arguments
     {
-        if (argNum > 3) // More than two arguments
+        int cameraArguments = 0; //camera= may be given once per device
+        for (int argIdx = 3; argIdx < argNum; argIdx++)
+        {
+            if (std::strncmp(argStrings[argIdx], "camera=", 7) == 0)
+            {
+                cameraArguments++;
+            }
+        }
+        if (argNum - cameraArguments > 33) // More than thirty-two arguments besides the cameras
         {
             std::cout << "Too many arguments.\n" << expected << defaultPath << outWillBe << OpenPoseOutPath << "\"\n";
         }//If more than one argument
@@ -195,31 +541,292 @@ bool checkCmdLine(int argNum, char** argStrings)
         colorHeight = std::stoi(dimension); //Height
 
         depthVertices = new rs2::vertex[colorWidth * colorHeight]; //Allocate memory for the depth vector 
+
+        //Parse the optional <field>=<value> arguments
+        for (int argIdx = 3; argIdx < argNum; argIdx++)
+        {
+            std::string argument(argStrings[argIdx]);
+            std::string field = argument.substr(0, argument.find('='));
+            std::string value = argument.substr(argument.find('=') + 1);
+
+            if (field == "align") //Registration mode
+            {
+                if (value == "sdk")
+                {
+                    registrationMode = REGISTRATION_SDK;
+                }
+                else if (value == "full")
+                {
+                    registrationMode = REGISTRATION_FULL;
+                }
+                else if (value == "sparse")
+                {
+                    registrationMode = REGISTRATION_SPARSE;
+                }
+                else
+                {
+                    std::cout << "\"" << value << "\" is not a valid align mode.\n" << expected;
+                    return false;
+                }
+            }
+            else if (field == "verify") //Compare DepthAligner with rs2::align
+            {
+                verifyReplay = value == "replay";
+                verifyAlignment = verifyReplay || isTrue(value);
+            }
+            else if (field == "threads") //Alignment threads
+            {
+                alignThreads = std::max(1, std::stoi(value));
+            }
+            else if (field == "bag") //Replay a recording
+            {
+                bagFile = value;
+            }
+            else if (field == "stats") //Per-frame timing
+            {
+                printStats = isTrue(value);
+            }
+            else if (field == "lut") //Color ray table resolution
+            {
+                colorTableStep = std::max(0, std::stoi(value));
+            }
+            else if (field == "watch") //How new OpenPose files are found
+            {
+                if (value == "events" || value == "poll")
+                {
+                    watchEvents = value == "events";
+                }
+                else
+                {
+                    std::cout << "\"" << value << "\" is not a valid watch mode.\n" << expected;
+                    return false;
+                }
+            }
+            else if (field == "catchup") //Drain every finished keypoint file
+            {
+                catchUp = isTrue(value);
+            }
+            else if (field == "history") //Depth frames kept for matching
+            {
+                historyFrames = std::max(1, std::stoi(value));
+            }
+            else if (field == "delay") //OpenPose's pipeline delay
+            {
+                pipelineDelayMs = std::max(0.0, std::stod(value));
+            }
+            else if (field == "queue") //Depth frames waiting for fusion
+            {
+                queueFrames = std::max(1, std::stoi(value));
+            }
+            else if (field == "drop") //Capture queue drop policy
+            {
+                if (value == "oldest")
+                {
+                    dropPolicy = DROP_OLDEST;
+                }
+                else if (value == "block")
+                {
+                    dropPolicy = BLOCK;
+                }
+                else
+                {
+                    std::cout << "\"" << value << "\" is not a valid drop policy.\n" << expected;
+                    return false;
+                }
+            }
+            else if (field == "handoff") //Every depth frame or only the newest
+            {
+                if (value == "queue" || value == "latest")
+                {
+                    latestOnly = value == "latest";
+                }
+                else
+                {
+                    std::cout << "\"" << value << "\" is not a valid handoff mode.\n" << expected;
+                    return false;
+                }
+            }
+            else if (field == "stagequeue") //Pipeline queue sizes
+            {
+                stageQueueSize = std::max(1, std::stoi(value));
+            }
+            else if (field == "fusion") //Pipeline thread counts
+            {
+                fusionThreads = std::max(1, std::stoi(value));
+            }
+            else if (field == "serialize")
+            {
+                serializeThreads = std::max(1, std::stoi(value));
+            }
+            else if (field == "sinks")
+            {
+                sinkThreads = std::max(1, std::stoi(value));
+            }
+            else if (field == "personthreads") //Per-person fusion
+            {
+                personThreads = std::max(1, std::stoi(value));
+            }
+            else if (field == "personcutoff")
+            {
+                personCutoff = std::max(1, std::stoi(value));
+            }
+            else if (field == "world") //Multi-view fusion
+            {
+                worldPoseFile = value;
+            }
+            else if (field == "worldout")
+            {
+                worldOutputPath = value;
+            }
+            else if (field == "window")
+            {
+                worldWindowMs = std::max(0.0, std::stod(value));
+            }
+            else if (field == "offline")
+            {
+                offlineWorld = isTrue(value);
+            }
+            else if (field == "calibration") //Calibration cache
+            {
+                calibrationDirectory = value == "off" ? std::string() : value;
+            }
+            else if (field == "warmup") //Longest warm-up
+            {
+                warmUpMaxFrames = std::max(1, std::stoi(value));
+            }
+            else if (field == "ready") //Ready signal port
+            {
+                readyPort = std::stoi(value);
+            }
+            else if (field == "benchmark") //Time reading keypoint files, or registration on a recording, and exit
+            {
+                benchmarkReplay = value == "replay";
+                runBenchmark = benchmarkReplay || isTrue(value);
+            }
+            else if (field == "precision") //Decimals of the written 3D coordinates
+            {
+                outputDecimals = std::max(-1, std::stoi(value));
+            }
+            else if (field == "splice") //Splice the 3D arrays into OpenPose's text
+            {
+                spliceOutput = isTrue(value);
+            }
+            else if (field == "output") //Which depth files to write
+            {
+                if (value == "json" || value == "binary" || value == "both")
+                {
+                    writeJson = value != "binary";
+                    writeBinary = value != "json";
+                }
+                else
+                {
+                    std::cout << "\"" << value << "\" is not a valid output format.\n" << expected;
+                    return false;
+                }
+            }
+            else if (field == "camera") //One of several devices, each with its own OpenPose output directory
+            {
+                size_t comma = value.find(',');
+                if (comma == std::string::npos || comma == 0 || comma + 1 == value.size() || !addCamera(value.substr(0, comma), value.substr(comma + 1)))
+                {
+                    std::cout << "\"" << value << "\" is not a valid camera, expected <serial or recording.bag>,<output directory>.\n" << expected;
+                    return false;
+                }
+            }
+            else
+            {
+                std::cout << "\"" << field << "\" is not a valid argument name.\n" << expected;
+                return false;
+            }
+        }//For all optional arguments
+
+        if (verifyAlignment && !verifyReplay && registrationMode != REGISTRATION_FULL)
+        {
+            std::cout << "verify=true only applies to align=full, ignoring it.\n";
+            verifyAlignment = false;
+        }
     }
     else //There were no arguments
     {
         std::cout << "No arguments detected\n";
     }
 
-    std::cout << outWillBe << OpenPoseOutPath << "\"\n";
+    if (cameras.empty()) //No camera= arguments, so a single camera (or bag=) writing to the positional directory
+    {
+        addCamera(bagFile, OpenPoseOutPath);
+    }
+    else if (!bagFile.empty())
+    {
+        std::cout << "bag= is ignored when cameras are listed with camera=.\n";
+    }
+
+    for (CameraContext* camera : cameras)
+    {
+        std::cout << camera->name << ": " << outWillBe << camera->outputPath << "\"\n";
+        if (!prepareOutputDirectory(camera->outputPath))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}//checkCmdLine()
+
+
+
+//Adds a camera to handle. device is a serial number, a .bag recording, or empty for the first device found.
+bool addCamera(const std::string& device, const std::string& outputPath)
+{
+    CameraContext* camera = new CameraContext();
+    camera->outputPath = outputPath;
+    camera->poseName = device;
+    camera->index = (int)cameras.size();
+    if (device.size() > 4 && device.compare(device.size() - 4, 4, ".bag") == 0)
+    {
+        camera->bagFile = device;
+        camera->name = "Recording " + device;
+    }
+    else
+    {
+        camera->serial = device;
+        camera->name = device.empty() ? std::string("Camera") : "Camera " + device;
+    }
+
+    for (CameraContext* other : cameras)
+    {
+        if (other->outputPath == camera->outputPath)
+        {
+            std::cout << camera->name << " and " << other->name << " can not share the output directory \"" << outputPath << "\".\n";
+            delete camera;
+            return false;
+        }
+    }
+    cameras.push_back(camera);
+    return true;
+}//addCamera()
+
 
+
+//Ensures an OpenPose output directory is ready for use and sets its ready file to false
+bool prepareOutputDirectory(const std::string& outputPath)
+{
     //Check if the directory needs to be cleaned up first or can be accessed at all
-    std::ifstream input(OpenPoseOutPath + "\\000000000000_keypoints.json"); //open the first keypoint file created by OpenPose
-    std::ifstream readyInput(OpenPoseOutPath + "\\ready.txt"); //open a file named "ready.txt"
+    std::ifstream input(joinPath(outputPath, "000000000000_keypoints.json")); //open the first keypoint file created by OpenPose
+    std::ifstream readyInput(joinPath(outputPath, "ready.txt")); //open a file named "ready.txt"
 
     /* Allow opening old files
     if (!input.fail()) //If the file open succedded, there must be old files there!
     {
-        std::cout << "There are old keypoint files in \"" << OpenPoseOutPath << "\" still. Please remove them or select another directory.\n";
+        std::cout << "There are old keypoint files in \"" << outputPath << "\" still. Please remove them or select another directory.\n";
         return false;
     }*/
 
     if (readyInput.fail()) //If opening the "ready" file failed
     {
-        std::ofstream readyOutput(OpenPoseOutPath + "\\ready.txt");
+        std::ofstream readyOutput(joinPath(outputPath, "ready.txt"));
         if (readyOutput.fail()) //If the file opening failed
         {
-            std::cout << "The specified directory \"" << OpenPoseOutPath << "\"could not be written to. Please ensure that you have proper permissions and wrote the path correctly.\n";
+            std::cout << "The specified directory \"" << outputPath << "\"could not be written to. Please ensure that you have proper permissions and wrote the path correctly.\n";
             return false;
         }
         else
@@ -232,50 +839,181 @@ bool checkCmdLine(int argNum, char** argStrings)
         readyInput.ignore(15); // Clear the old contents of the file
         readyInput.close();
 
-        std::ofstream readyOutput(OpenPoseOutPath + "\\ready.txt");
+        std::ofstream readyOutput(joinPath(outputPath, "ready.txt"));
         readyOutput << "false"; //Set the default value of the file to be "false" since this program is not ready for OpenPose to start yet
         readyOutput.close();
     }
 
     return true;
-}//checkCmdLine()
+}//prepareOutputDirectory()
 
 
 
-//Runs the camera for a handful of frames until the exposure stabilizes and then collects the
-//  intrinsics, extrinsics, and a single color frame as a baseline for future alignment.
-void getBaselineFrameAndCameraValues()
+//Gets a camera's intrinsics, extrinsics, and depth scale the quickest way that works: from the calibration cache, from
+//  the device's stream profiles without streaming (then cached), or from the warm-up capture (then cached). rs2::align
+//  (align=sdk or verify=true) needs a color frame and recordings have no firmware to check the cache against, so those
+//  always use the warm-up capture.
+void loadCameraValues(CameraContext& camera)
 {
-    std::cout << "Capturing baseline...\n";
-
-    rs2::pipeline pipe; // Create a pipeline
-
-    rs2::config cfg; //set up the configuration of the camera
-    cfg.enable_stream(RS2_STREAM_DEPTH, depthWidth, depthHeight, RS2_FORMAT_Z16, 30); //Full resolution and max FPS to speed up process
-    cfg.enable_stream(RS2_STREAM_COLOR, colorWidth, colorHeight, RS2_FORMAT_BGR8, 30); //Note that the color stream is ENABLED, matched FPS with depth
-
-    pipe.start(cfg);
-
-    for (int i = 0; i < 30; i++) //throw out first ~1 sec of frames (30FPS * 30 = 1sec)
+    auto start = std::chrono::steady_clock::now();
+    if (registrationMode == REGISTRATION_SDK || verifyAlignment || !camera.bagFile.empty() || calibrationDirectory.empty())
     {
-        pipe.wait_for_frames(); //get a frame (but don't bother saving it)
-    }// for ~1 second of frames
+        getBaselineFrameAndCameraValues(camera);
+        camera.calibrationSource = "the warm-up capture";
+        camera.calibrationMs = elapsedMs(start, std::chrono::steady_clock::now());
+        std::cout << "Warm-up capture took " << camera.calibrationMs << " ms\n";
+        return;
+    }
 
-    rs2::frameset frameset = pipe.wait_for_frames(); //save a frameset
+    //The device itself, by serial number or the first one found
+    rs2::device device;
+    bool found = false;
+    try
+    {
+        rs2::context context;
+        rs2::device_list devices = context.query_devices();
+        for (size_t i = 0; i < devices.size() && !found; i++)
+        {
+            found = camera.serial.empty() || camera.serial == devices[i].get_info(RS2_CAMERA_INFO_SERIAL_NUMBER);
+            if (found)
+            {
+                device = devices[i];
+            }
+        }
+    }
+    catch (const rs2::error& e)
+    {
+        std::cout << "Could not list the cameras: " << e.what() << "\n";
+    }
+    if (!found)
+    {
+        getBaselineFrameAndCameraValues(camera); //Let the pipeline find it, or say why it can't
+        camera.calibrationSource = "the warm-up capture";
+        camera.calibrationMs = elapsedMs(start, std::chrono::steady_clock::now());
+        std::cout << "Warm-up capture took " << camera.calibrationMs << " ms\n";
+        return;
+    }
+    camera.serial = device.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER); //Stream from this same device later
+    std::string firmware = device.get_info(RS2_CAMERA_INFO_FIRMWARE_VERSION);
+    std::string cachePath = calibrationCachePath(calibrationDirectory, camera.serial, depthWidth, depthHeight, colorWidth, colorHeight);
+
+    CameraCalibration calibration;
+    std::string& source = camera.calibrationSource;
+    if (loadCalibration(cachePath, firmware, depthWidth, depthHeight, colorWidth, colorHeight, calibration))
+    {
+        source = "the calibration cache";
+    }
+    else if (queryCalibration(device, depthWidth, depthHeight, colorWidth, colorHeight, 30, calibration))
+    {
+        source = "the device";
+        saveCalibration(cachePath, firmware, calibration);
+    }
+    else
+    {
+        getBaselineFrameAndCameraValues(camera);
+        calibration.colorIntrinsics = camera.colorIntrinsics;
+        calibration.depthIntrinsics = camera.depthIntrinsics;
+        calibration.depth2ColorExtrinsics = camera.depth2ColorExtrinsics;
+        calibration.depthScale = camera.depthScale;
+        source = "the warm-up capture";
+        saveCalibration(cachePath, firmware, calibration);
+    }
+
+    camera.colorIntrinsics = calibration.colorIntrinsics;
+    camera.depthIntrinsics = calibration.depthIntrinsics;
+    camera.depth2ColorExtrinsics = calibration.depth2ColorExtrinsics;
+    camera.depthScale = calibration.depthScale;
+    camera.calibrationMs = elapsedMs(start, std::chrono::steady_clock::now());
+    std::cout << camera.name << ": camera values from " << source << " in " << camera.calibrationMs << " ms\n";
+}//loadCameraValues()
+
+
+
+//Runs the camera until the exposure stabilizes (see WarmUp.hpp) and then collects the
+//  intrinsics and extrinsics from the stream profiles. Only rs2::align (align=sdk or verify=true) needs actual color
+//  pixels, so only then is a single color frame kept as a baseline for future alignment.
+void getBaselineFrameAndCameraValues(CameraContext& camera)
+{
+    std::cout << "Capturing baseline of " << camera.name << "...\n";
+
+    rs2::pipeline pipe; // Create a pipeline
+
+    rs2::config cfg; //set up the configuration of the camera
+    if (!camera.bagFile.empty())
+    {
+        cfg.enable_device_from_file(camera.bagFile); //The recording must contain both streams
+    }
+    else if (!camera.serial.empty())
+    {
+        cfg.enable_device(camera.serial);
+    }
+    cfg.enable_stream(RS2_STREAM_DEPTH, depthWidth, depthHeight, RS2_FORMAT_Z16, 30); //Full resolution and max FPS to speed up process
+    cfg.enable_stream(RS2_STREAM_COLOR, colorWidth, colorHeight, RS2_FORMAT_BGR8, 30); //Note that the color stream is ENABLED, matched FPS with depth
+
+    rs2::pipeline_profile profile = pipe.start(cfg);
+
+    //Throw out frames until both cameras' auto-exposure has settled
+    auto warmUpStart = std::chrono::steady_clock::now();
+    ExposureConvergence depthExposure;
+    ExposureConvergence colorExposure;
+    int warmUpFrames = 0;
+    bool converged = false;
+    while (warmUpFrames < warmUpMaxFrames && !converged)
+    {
+        rs2::frameset frameset = pipe.wait_for_frames(); //get a frame (but don't bother saving it)
+        warmUpFrames++;
+        bool depthSettled = depthExposure.add(frameset.get_depth_frame());
+        bool colorSettled = colorExposure.add(frameset.get_color_frame());
+        if (!depthExposure.hasMetadata() || !colorExposure.hasMetadata())
+        {
+            converged = warmUpFrames >= std::min(WARM_UP_FIXED_FRAMES, warmUpMaxFrames); //Can't tell, wait the fixed time
+        }
+        else
+        {
+            converged = depthSettled && colorSettled;
+        }
+    }//Until the exposure settles
+
+    std::cout << "Warm-up: " << warmUpFrames << " frames in " << elapsedMs(warmUpStart, std::chrono::steady_clock::now()) << " ms, ";
+    if (!depthExposure.hasMetadata() || !colorExposure.hasMetadata())
+    {
+        std::cout << "no exposure metadata so a fixed count was used\n";
+    }
+    else
+    {
+        if (converged)
+        {
+            std::cout << "exposure settled";
+        }
+        else
+        {
+            std::cout << "exposure still changing after warmup=" << warmUpMaxFrames << " frames";
+        }
+        std::cout << " (color exposure " << colorExposure.exposure() << " us, gain " << colorExposure.gain() << ")\n";
+    }
 
-    //Get the separate color and depth frames
-    auto depth = frameset.get_depth_frame();
-    auto color = frameset.get_color_frame();
+    //Get the stream profiles, their camera values are all that the sparse and full registration need
+    rs2::video_stream_profile depthProfile = profile.get_stream(RS2_STREAM_DEPTH).as<rs2::video_stream_profile>();
+    rs2::video_stream_profile colorProfile = profile.get_stream(RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
 
-    //Get the camera intrinsics and save them to the global variables
-    depthIntrinsics = depth.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
-    colorIntrinsics = color.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+    //Get the camera intrinsics
+    camera.depthIntrinsics = depthProfile.get_intrinsics();
+    camera.colorIntrinsics = colorProfile.get_intrinsics();
 
-    //Get the depth camera to color camera extrinsics and save them to the global variable
-    depth2ColorExtrinsics = depth.get_profile().get_extrinsics_to(color.get_profile());
+    //Get the depth camera to color camera extrinsics
+    camera.depth2ColorExtrinsics = depthProfile.get_extrinsics_to(colorProfile);
 
-    color.keep(); //Retain this frame, by default, old frames are overwritten in memory
-    baselineColorFrame = color; //Remember that this is actually an rs::video_frame
+    //Meters per depth unit, needed to read the raw depth frames directly
+    camera.depthScale = profile.get_device().first<rs2::depth_sensor>().get_depth_scale();
+
+    if (registrationMode == REGISTRATION_SDK || verifyAlignment) //rs2::align needs a color frame to align to
+    {
+        rs2::frameset frameset = pipe.wait_for_frames(); //save a frameset
+        auto color = frameset.get_color_frame();
+
+        color.keep(); //Retain this frame, by default, old frames are overwritten in memory
+        camera.baselineColorFrame = color; //Remember that this is actually an rs::video_frame
+    }
 
     pipe.stop();
 
@@ -285,210 +1023,873 @@ void getBaselineFrameAndCameraValues()
 
 
 //Sets the ready file to true so that OpenPose knows it can use the color camera
-void setReady()
+void setReady(const std::string& outputPath)
 {
-    std::ifstream readyInput(OpenPoseOutPath + "\\ready.txt");
+    std::ifstream readyInput(joinPath(outputPath, "ready.txt"));
     readyInput.ignore(15); //Clear the old contents of the file
 
-    std::ofstream readyOutput(OpenPoseOutPath + "\\ready.txt");
+    std::ofstream readyOutput(joinPath(outputPath, "ready.txt"));
     readyOutput << "true"; //Insert "true" into the ready.txt file
 }//setReady()
 
 
 
-//Updates the keypointfiles generated by OpenPose with depth data when there is a new frame
-void updateKeypoints(const rs2::depth_frame* depthFrame, int& frameNumber)
+//Startup from main() to the color sensors being released: parsing the arguments (and loading the world poses), then
+//  each camera's values. With ready=<port> the same numbers go to the launcher as one line of JSON.
+void reportStartup(double argumentsMs, double totalMs)
 {
-    //Generate the new filename
-    std::string fileName = "\\000000000000_keypoints.json";
+    json timings;
+    timings["arguments"] = argumentsMs;
+    timings["cameras"] = json::array();
+    std::cout << "Ready after " << totalMs << " ms: arguments " << argumentsMs << " ms";
+    for (CameraContext* camera : cameras)
+    {
+        timings["cameras"].push_back({ { "name", camera->name }, { "source", camera->calibrationSource }, { "ms", camera->calibrationMs } });
+        std::cout << ", " << camera->name << " " << camera->calibrationMs << " ms (" << camera->calibrationSource << ")";
+    }
+    timings["total"] = totalMs;
+    std::cout << "\n";
+
+    if (readyPort > 0)
+    {
+        json message;
+        message["ready"] = true;
+        message["timings_ms"] = timings;
+        sendReadySignal(readyPort, message.dump());
+    }
+}//reportStartup()
+
+
+
+//Name of the keypoint file OpenPose writes for a frame, join it to a directory with joinPath()
+std::string keypointFileName(int frameNumber)
+{
+    std::string fileName = "000000000000_keypoints.json";
     std::string digitString = std::to_string(frameNumber);
     int digitNumber = digitString.length(); //Get the length of the frame number
 
-    fileName.replace(13 - digitNumber, digitNumber, digitString); //replace the zeros on the right with the frame number
+    fileName.replace(12 - digitNumber, digitNumber, digitString); //replace the zeros on the right with the frame number
+    return fileName;
+}//keypointFileName()
+
+
+
+//The backlog, counted on disk: the watcher's events miss files found by polling (watch=poll, startup, lost events),
+//  which is when a backlog builds up. Stops at the first missing file (OpenPose writes them in order), the one
+//  OpenPose is still writing counts too. Only counts up to 100 so a huge backlog doesn't slow registration further.
+int countWaitingFiles(const CameraContext& camera)
+{
+    int waiting = 0;
+    while (waiting < 100 && camera.keypointWatcher->fileExists(keypointFileName(camera.frameNumber + waiting)))
+    {
+        waiting++;
+    }
+    return waiting;
+}//countWaitingFiles()
+
 
 
-    //Check if new file (i.e. a new frame)
-    std::ifstream keyframeFile(OpenPoseOutPath + fileName);
+//Stage 2: takes the depth frames a camera's capture thread has queued (or just the newest one), then registers the
+//  camera's next keypoint file, or every finished one in catch-up mode, and hands them to fusion. Returns the number of
+//  files registered, or -1 if there was no new depth frame.
+int registerNewFiles(CameraContext& camera, BoundedQueue<KeypointJob*>& freeJobs, BoundedQueue<KeypointJob*>& fusionQueue, StageStats& stats)
+{
+    const DepthSlot* newest = nullptr;
+    if (latestOnly)
+    {
+        newest = camera.latestDepth->take();
+    }
+    else
+    {
+        DepthSlot* slot;
+        while ((slot = camera.captureQueue->pop()) != nullptr)
+        {
+            DepthSlot* oldest = camera.depthRing->add(slot);
+            if (oldest != nullptr)
+            {
+                camera.captureQueue->release(oldest); //The capture thread can reuse it
+            }
+            newest = slot;
+        }
+    }
+    if (newest == nullptr)
+    {
+        return -1;
+    }
+
+    if (registrationMode == REGISTRATION_SDK && !camera.sdkAligner->process(newest->depth.data(), newest->hardwareTimestamp, camera.depthAligned)) //If both a color and depth frame were not ready
+    {
+        return -1;
+    }
+
+    int filesDone = 0;
+    std::string fileName = keypointFileName(camera.frameNumber);
+    while (camera.keypointWatcher->fileReady(fileName))
+    {
+        KeypointJob* job;
+        freeJobs.pop(job, &stats.outputWaitMicroseconds); //Waits if every job is still somewhere in the pipeline
+        auto workStart = std::chrono::steady_clock::now();
+        job->camera = &camera;
+        job->fileName = fileName;
+        job->frameNumber = camera.frameNumber;
+        job->written = fileWriteTime(joinPath(camera.outputPath, fileName));
+        job->started = workStart;
+        std::chrono::system_clock::time_point imageTime = job->written - std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::duration<double, std::milli>(pipelineDelayMs)); //When OpenPose's color image was taken
+        job->imageTimeMs = toMilliseconds(imageTime);
+        job->batch.setCamera(camera.colorIntrinsics, camera.colorRays); //Picks the deprojection compiled for the color camera's distortion model
+
+        if (!loadKeypoints(*job))
+        {
+            freeJobs.push(job);
+            camera.keypointWatcher->retry(fileName); //Try again next frame
+            break;
+        }
+
+        if (registrationMode == REGISTRATION_SDK)
+        {
+            findKeypointDepths(*job, (const uint16_t*)camera.depthAligned.get_data()); //The software device only takes frames in order, so no history
+        }
+        else
+        {
+            //The depth frame taken closest to OpenPose's color image
+            const DepthSlot& matched = latestOnly ? *newest : camera.depthRing->closest(imageTime);
+            findKeypointDepths(*job, prepareDepth(camera, matched));
+            if (printStats)
+            {
+                matchGapStats.add(std::fabs(elapsedMs(imageTime, matched.captured)));
+            }
+        }
+        stats.busyMicroseconds += elapsedMicroseconds(workStart);
+        stats.items++;
+        fusionQueue.push(job, &stats.outputWaitMicroseconds);
+
+        camera.frameNumber++;
+        filesDone++;
+        if (!catchUp)
+        {
+            break;
+        }
+        fileName = keypointFileName(camera.frameNumber);
+    }//While there are finished keypoint files
+
+    return filesDone;
+}//registerNewFiles()
+
+
+
+//Gets a depth frame ready for the registration mode: aligned to the color image for align=full, as it is for sparse
+//  (not used for align=sdk, which aligns every frame as it arrives)
+const uint16_t* prepareDepth(CameraContext& camera, const DepthSlot& depth)
+{
+    if (registrationMode == REGISTRATION_FULL)
+    {
+        if (depth.frameNumber != camera.alignedFrameNumber) //Several files may match the same depth frame
+        {
+            camera.depthAligner->alignTiled(depth.depth.data(), camera.alignedDepth.data(), *workerPool); //Align the depth to the color frame
+            camera.alignedFrameNumber = depth.frameNumber;
+
+            rs2::depth_frame depthAligned = rs2::frame(); //depth_frame has no default constructor
+            if (verifyAlignment && camera.sdkAligner->process(depth.depth.data(), depth.hardwareTimestamp, depthAligned))
+            {
+                checkAlignment(camera, depthAligned);
+            }
+        }
+        return camera.alignedDepth.data();
+    }
+
+    return depth.depth.data(); //Sparse registers the keypoints straight to the raw depth frame
+}//prepareDepth()
+
+
+
+//Registration stage: loads a keypoint file generated by OpenPose and reads its 2D keypoints (see KeypointReader.hpp),
+//  leaving the rest of the file to fusion. Returns false if the file could not be read.
+bool loadKeypoints(KeypointJob& job)
+{
+    std::ifstream keyframeFile(joinPath(job.camera->outputPath, job.fileName), std::ios::binary);
     if (keyframeFile.good() == 0) //If file not able to be opened
     {
-        return; //Do nothing
+        return false;
     }
-    else //Else the file was loaded, so fill the depth data
+    keyframeFile.seekg(0, std::ios::end);
+    job.source.resize((size_t)std::max<std::streamoff>(0, keyframeFile.tellg()));
+    keyframeFile.seekg(0, std::ios::beg);
+    keyframeFile.read(&job.source[0], (std::streamsize)job.source.size());
+    job.source.resize((size_t)keyframeFile.gcount());
+
+    std::string error;
+    if (!readKeypoints(job.source.data(), job.source.size(), job.keypoints, error)) //Sometimes the files are opened too soon
     {
-        //Load the file into a JSON object, iterate through all people, iterate through all joints, and update each with the corresponding depth
-        //Insert the file into a JSON object for easy handling
-        json jsn;
-        try //Sometimes the files are opened too soon so the JSON interpreter throws an exception
+        std::cout << "Likely an empty file. File Name: " << job.fileName << "\n";
+        std::cerr << "The keypoints could not be read: " << error << std::endl;
+        return false;
+    }
+    return true;
+}//loadKeypoints()
+
+
+
+//Registration stage: gathers every keypoint of every person and finds the depth behind each one, so fusion can deproject
+//  them in one batch
+void findKeypointDepths(KeypointJob& job, const uint16_t* depthData)
+{
+    KeypointBatch& batch = job.batch;
+    const KeypointFile& keypoints = job.keypoints;
+    batch.clear();
+    job.personStart.clear();
+    for (size_t i = 0; i < keypoints.people(); i++) //For all people
+    {
+        job.personStart.push_back(batch.size());
+        for (int part = 0; part < KEYPOINT_PART_COUNT; part++) //Body, face, and hands, nothing if a part is missing
         {
-            keyframeFile >> jsn;
+            const double* keypoints2d = keypoints.part(i, part);
+            for (size_t j = 0; j + 2 < keypoints.partValues(i, part); j += 3) //x, y, confidence
+            {
+                batch.add((float)keypoints2d[j], (float)keypoints2d[j + 1]);
+            }
         }
-        catch (const json::exception& e)
+    }//For all people
+
+    //Set the depth of every keypoint that exists and is within possible ranges
+    float keypointPixel[2];
+    for (size_t k = 0; k < batch.size(); k++)
+    {
+        keypointPixel[0] = batch.u[k];
+        keypointPixel[1] = batch.v[k];
+        if (keypointPixel[0] > 0 && keypointPixel[1] > 0 && keypointPixel[0] < colorWidth && keypointPixel[1] < colorHeight)
         {
-            std::cout << "Likely an empty file. File Name: " << fileName << "\n";
-            std::cerr << "JSON threw an exception: " << e.what() << "\n" << "ExceptionID: " << e.id << std::endl;
-            return;
+            batch.depth[k] = getKeypointDepth(*job.camera, depthData, keypointPixel);
         }
-        keyframeFile.close(); //close the file (since we will need to write to it shortly)
+    }
+    job.personStart.push_back(batch.size());
+}//findKeypointDepths()
 
-        unsigned int i, j;
-        float keypointPixel[2] = { 0, 0 }; //Iterators and temp keypoint pixel information
-        float keypointDepth = 0.0;
-        double confidence; //Temp confidence value
-        float tempPoint[3] = {0, 0, 0 }; //Temp 3D point to be inserted into keyframe
-        double tempPose3d[25 * 4], tempFace3d[69 * 4], tempLeftHand3d[21 * 4], tempRightHand3d[21 * 4]; //3D pose and face arrays to hold temp values to insert into each file
 
-        bool insertFace = true; //Assume that there are face keypoints
-        bool insertHand = true; //...and hand keypoints
 
-        for (i = 0; i < jsn["people"].size(); i++) //For all people
+//Fusion stage: deprojects the keypoints into job.points. Crowded files are split by person across personPool, each
+//  person only touching their own keypoints, so the output is the same. The whole file is only parsed with
+//  splice=false; world fusion only needs the 3D arrays.
+void fuseKeypoints(KeypointJob& job)
+{
+    KeypointBatch& batch = job.batch;
+    batch.sizeOutput();
+    job.points.assign(4 * batch.size(), 0.0f);
+    int personCount = (int)job.personStart.size() - 1;
+
+    auto fuseOne = [&](int i) {
+        batch.deproject(job.personStart[i], job.personStart[i + 1] - job.personStart[i]); //All of the person's parts at once
+        fusePerson(job.keypoints, (size_t)i, batch, job.personStart[i], job.points);
+    };
+    if (personPool != nullptr)
+    {
+        personPool->parallelFor(personCount, fuseOne, personCutoff);
+    }
+    else
+    {
+        for (int i = 0; i < personCount; i++)
         {
-            //Update body keypoints
-            for (j = 0; j < 25; j++) //for all 25 pose keypoints
+            fuseOne(i);
+        }
+    }
+
+    if (writeJson && !spliceOutput)
+    {
+        job.document = json::parse(job.source); //Registration already read it without errors
+        addPoints(job, job.document["people"]);
+    }
+    else if (worldFusion != nullptr)
+    {
+        job.document = json::object();
+        json& people = job.document["people"];
+        people = json::array();
+        for (size_t i = 0; i < job.keypoints.people(); i++)
+        {
+            people.push_back(json::object());
+        }
+        addPoints(job, people);
+    }
+}//fuseKeypoints()
+
+
+
+//Fills in one person's deprojected keypoints, walking them in the same order they were gathered
+void fusePerson(const KeypointFile& keypoints, size_t personIndex, const KeypointBatch& batch, size_t firstKeypoint, std::vector<float>& points)
+{
+    size_t k = firstKeypoint;
+    for (int part = 0; part < KEYPOINT_PART_COUNT; part++)
+    {
+        const double* keypoints2d = keypoints.part(personIndex, part);
+        size_t keypointCount = keypoints.partValues(personIndex, part) / 3; //0 if there is no such part
+        for (size_t j = 0; j < keypointCount; j++, k++)
+        {
+            if (batch.u[k] > 0 && batch.v[k] > 0 && batch.u[k] < colorWidth && batch.v[k] < colorHeight) //Otherwise all 0
             {
-                //Get the x and y coordinates of each keypoint
-                keypointPixel[0] = jsn["people"][i]["pose_keypoints_2d"][3 * j];
-                keypointPixel[1] = jsn["people"][i]["pose_keypoints_2d"][3 * j + 1];
-                confidence = jsn["people"][i]["pose_keypoints_2d"][3 * j + 2];
+                points[4 * k] = batch.x[k];
+                points[4 * k + 1] = batch.y[k];
+                points[4 * k + 2] = batch.z[k];
+                points[4 * k + 3] = (float)keypoints2d[3 * j + 2];
+            }
+        }
+    }
+}//fusePerson()
 
-                if (keypointPixel[0] > 0 && keypointPixel[1] > 0 && keypointPixel[0] < colorWidth && keypointPixel[1] < colorHeight) // if keypoint exists and within possible ranges
-                {
-                    //Set the x, y, and depth
-                    keypointDepth = depthFrame->get_distance(keypointPixel[0], keypointPixel[1]);
-                    rs2_deproject_pixel_to_point(tempPoint, & colorIntrinsics, keypointPixel, keypointDepth);
-                    tempPose3d[4 * j] = tempPoint[0];
-                    tempPose3d[4 * j + 1] = tempPoint[1];
-                    tempPose3d[4 * j + 2] = tempPoint[2];
-                    tempPose3d[4 * j + 3] = confidence;
-                }
-                else //If there was no keypoint
-                {
-                    //Set the values to 0
-                    tempPose3d[4 * j] = 0;
-                    tempPose3d[4 * j + 1] = 0;
-                    tempPose3d[4 * j + 2] = 0;
-                    tempPose3d[4 * j + 3] = 0; // "Confidence" = 0
-                }
-            }//For all 25 body keypoints
-			
-			try{
-				//Left Hand
-				for (j = 0; j < 21; j++) //for all 21 pose keypoints
-				{
-					//Get the x and y coordinates of each keypoint
-                    keypointPixel[0] = jsn["people"][i]["hand_left_keypoints_2d"][3 * j];
-                    keypointPixel[1] = jsn["people"][i]["hand_left_keypoints_2d"][3 * j + 1];
-					confidence = jsn["people"][i]["hand_left_keypoints_2d"][3 * j + 2];
-
-                    if (keypointPixel[0] > 0 && keypointPixel[1] > 0 && keypointPixel[0] < colorWidth && keypointPixel[1] < colorHeight) // if keypoint exists and within possible ranges
-					{
-						//Set the x, y, and depth
-                        keypointDepth = depthFrame->get_distance(keypointPixel[0], keypointPixel[1]);
-                        rs2_deproject_pixel_to_point(tempPoint, &colorIntrinsics, keypointPixel, keypointDepth);
-						tempLeftHand3d[4 * j] = tempPoint[0];
-						tempLeftHand3d[4 * j + 1] = tempPoint[1];
-						tempLeftHand3d[4 * j + 2] = tempPoint[2];
-						tempLeftHand3d[4 * j + 3] = confidence;
-					}
-					else //If there was no keypoint
-					{
-						//Set the values to 0
-						tempLeftHand3d[4 * j] = 0;
-						tempLeftHand3d[4 * j + 1] = 0;
-						tempLeftHand3d[4 * j + 2] = 0;
-						tempLeftHand3d[4 * j + 3] = 0; // "Confidence" = 0
-					}
-				}//For left hand 21 keypoints
-
-				//Right Hand
-				for (j = 0; j < 21; j++) //for all 21 pose keypoints
-				{
-					//Get the x and y coordinates of each keypoint
-                    keypointPixel[0] = jsn["people"][i]["hand_right_keypoints_2d"][3 * j];
-                    keypointPixel[1] = jsn["people"][i]["hand_right_keypoints_2d"][3 * j + 1];
-					confidence = jsn["people"][i]["hand_right_keypoints_2d"][3 * j + 2];
-
-                    if (keypointPixel[0] > 0 && keypointPixel[1] > 0 && keypointPixel[0] < colorWidth && keypointPixel[1] < colorHeight) // if keypoint exists and within possible ranges
-					{
-						//Set the x, y, and depth
-                        keypointDepth = depthFrame->get_distance(keypointPixel[0], keypointPixel[1]);
-                        rs2_deproject_pixel_to_point(tempPoint, &colorIntrinsics, keypointPixel, keypointDepth);
-						tempRightHand3d[4 * j] = tempPoint[0];
-						tempRightHand3d[4 * j + 1] = tempPoint[1];
-						tempRightHand3d[4 * j + 2] = tempPoint[2];
-						tempRightHand3d[4 * j + 3] = confidence;
-					}
-					else //If there was no keypoint
-					{
-						//Set the values to 0
-						tempRightHand3d[4 * j] = 0;
-						tempRightHand3d[4 * j + 1] = 0;
-						tempRightHand3d[4 * j + 2] = 0;
-						tempRightHand3d[4 * j + 3] = 0; // "Confidence" = 0
-					}
-				}//For right hand 21 keypoints
-			}
-			catch(...)
-			{
-				insertHand = false;
-			}
-
-
-            try //Sometimes there are no face keypoints
-            {
-                for (j = 0; j < 69; j++) //For all 69 Face keypoints (Nice)
-                {
-                    //Get the x and y coordinates of each keypoint
-                    keypointPixel[0] = jsn["people"][i]["face_keypoints_2d"][3 * j];
-                    keypointPixel[0] = jsn["people"][i]["face_keypoints_2d"][3 * j + 1];
-                    confidence = jsn["people"][i]["face_keypoints_2d"][3 * j + 2];
 
-                    if (keypointPixel[0] > 0 && keypointPixel[1] > 0 && keypointPixel[0] < colorWidth && keypointPixel[1] < colorHeight) // if keypoint exists
-                    {
-                        //Set the x, y, and depth
-                        keypointDepth = depthFrame->get_distance(keypointPixel[0], keypointPixel[1]);
-                        rs2_deproject_pixel_to_point(tempPoint, &colorIntrinsics, keypointPixel, keypointDepth);
-                        tempFace3d[4 * j] = tempPoint[0];
-                        tempFace3d[4 * j + 1] = tempPoint[1];
-                        tempFace3d[4 * j + 2] = tempPoint[2];
-                        tempFace3d[4 * j + 3] = confidence;
-                    }
-                    else //If there was no keypoint
+
+//Adds each person's <part>_keypoints_3d arrays to people, the file's people array. Parts OpenPose didn't find (no
+//  2D array, or an empty one) get none.
+void addPoints(const KeypointJob& job, json& people)
+{
+    const KeypointFile& keypoints = job.keypoints;
+    for (size_t i = 0; i < keypoints.people(); i++)
+    {
+        for (int part = 0; part < KEYPOINT_PART_COUNT; part++)
+        {
+            if (keypoints.partValues(i, part) < 3)
+            {
+                continue;
+            }
+            size_t first = job.personStart[i];
+            for (int before = 0; before < part; before++)
+            {
+                first += keypoints.partValues(i, before) / 3;
+            }
+            const float* partPoints = job.points.data() + 4 * first;
+            people[i][std::string(keypointParts[part]) + "_keypoints_3d"] = std::vector<float>(partPoints, partPoints + 4 * (keypoints.partValues(i, part) / 3));
+        }
+    }
+}//addPoints()
+
+
+
+//Serialization stage: splices the 3D keypoints into OpenPose's text, or with splice=false writes the whole updated JSON
+//  as compact text (see KeypointWriter.hpp), and/or packs them into a binary file (see BinaryKeypoints.hpp), reusing
+//  the job's strings
+void serializeKeypoints(KeypointJob& job)
+{
+    if (writeBinary)
+    {
+        encodeBinaryKeypoints(job.keypoints, job.points, (uint64_t)job.frameNumber, job.imageTimeMs, job.binary);
+    }
+    if (!writeJson)
+    {
+        return;
+    }
+    if (spliceOutput)
+    {
+        KeypointWriter(outputDecimals).splice(job.source, job.keypoints, job.points, job.text);
+        return;
+    }
+    KeypointWriter(outputDecimals).write(job.document, job.text);
+}//serializeKeypoints()
+
+
+
+//Output stage: saves the updated file, and/or its binary version, next to OpenPose's
+void writeKeypoints(KeypointJob& job)
+{
+    std::string fileName = job.fileName;
+    fileName.insert(fileName.size() - 5, sizeof(char), 'D'); //Place a D for depth/done at the end of the file name
+    if (writeBinary)
+    {
+        std::ofstream output(joinPath(job.camera->outputPath, fileName.substr(0, fileName.size() - 5) + ".bin"), std::ios::binary);
+        output.write(job.binary.data(), (std::streamsize)job.binary.size());
+    }
+    if (writeJson)
+    {
+        std::ofstream output(joinPath(job.camera->outputPath, fileName));
+        output.write(job.text.data(), (std::streamsize)job.text.size()); //The whole file at once
+    }
+
+    if (printStats)
+    {
+        auto now = std::chrono::steady_clock::now();
+        fileLatencyStats.add(elapsedMs(job.started, now));
+        fileLagStats.add(elapsedMs(job.written, std::chrono::system_clock::now()));
+        fileSizeStats.add((double)((writeJson ? job.text.size() : 0) + (writeBinary ? job.binary.size() : 0)));
+    }
+}//writeKeypoints()
+
+
+
+//World fusion stage: hands the camera's people to WorldFusion and writes a world frame when the reference camera's
+//  file completes one. The job itself carries on unchanged.
+void fuseWorld(KeypointJob& job)
+{
+    json fused;
+    if (worldFusion->addView(job.camera->index, job.imageTimeMs, job.document, fused))
+    {
+        writeWorldFrame(fused);
+    }
+}//fuseWorld()
+
+
+
+//Saves a world frame as ############_keypointsW.json, numbered in the order they were made
+void writeWorldFrame(const json& fused)
+{
+    std::string fileName = keypointFileName(worldFrameNumber++);
+    fileName.insert(fileName.size() - 5, sizeof(char), 'W'); //W for world
+    static std::string text; //Only the world fusion stage (one thread) writes world frames
+    KeypointWriter(outputDecimals).write(fused, text);
+    std::ofstream output(joinPath(worldOutputPath, fileName));
+    output.write(text.data(), (std::streamsize)text.size());
+}//writeWorldFrame()
+
+
+
+//Fuses the *_keypointsD files already in every camera's output directory, in the order their color images were taken,
+//  the same way the world fusion stage would have. For trying out camera poses and fusion settings on a recording.
+//  Binary files (output=binary or both) carry the image time the live stage used. JSON files don't, so their own write
+//  time less delay= stands in for it, which adds the output stage's lag and any copying jitter.
+bool runOfflineWorldFusion()
+{
+    if (worldFusion == nullptr)
+    {
+        std::cout << "offline=true needs world=<camera pose file>.\n";
+        press2Close();
+        return false;
+    }
+
+    //Every recorded file of every camera, oldest first
+    std::vector<std::pair<double, std::pair<int, std::string>>> files; //Image time, (camera, path)
+    int writeTimeFiles = 0; //JSON files without a binary version
+    BinaryKeypointFrame binary;
+    std::string error;
+    for (CameraContext* camera : cameras)
+    {
+        for (int frame = 0;; frame++)
+        {
+            std::string path = joinPath(camera->outputPath, keypointFileName(frame));
+            path.replace(path.size() - 5, 5, "D"); //Without the .json
+            if (std::ifstream(path + ".bin").good() && readBinaryKeypoints(path + ".bin", binary, error))
+            {
+                files.push_back({ binary.timestampMs, { camera->index, path + ".bin" } });
+            }
+            else if (std::ifstream(path + ".json").good())
+            {
+                files.push_back({ toMilliseconds(fileWriteTime(path + ".json")) - pipelineDelayMs, { camera->index, path + ".json" } });
+                writeTimeFiles++;
+            }
+            else
+            {
+                break;
+            }
+        }
+        std::cout << camera->name << ": " << files.size() << " recorded files so far\n";
+    }
+    std::sort(files.begin(), files.end());
+    if (writeTimeFiles > 0)
+    {
+        std::cout << writeTimeFiles << " files have no binary version with their image time, so their write time was used. Record with output=both for the times the live fusion used.\n";
+    }
+
+    LatencyStats fusionStats("World fusion per view", (int)std::max<size_t>(files.size(), 1));
+    for (const auto& file : files)
+    {
+        json document;
+        const std::string& path = file.second.second;
+        if (path.compare(path.size() - 4, 4, ".bin") == 0)
+        {
+            if (!readBinaryKeypoints(path, binary, error))
+            {
+                std::cout << "Skipping: " << error << "\n";
+                continue;
+            }
+            binaryToJson(binary, document);
+        }
+        else
+        {
+            try
+            {
+                std::ifstream input(path);
+                document = json::parse(input);
+            }
+            catch (const json::exception& e)
+            {
+                std::cout << "Skipping \"" << path << "\": " << e.what() << "\n";
+                continue;
+            }
+        }
+
+        json fused;
+        auto start = std::chrono::steady_clock::now();
+        bool made = worldFusion->addView(file.second.first, file.first, document, fused);
+        fusionStats.add(elapsedMs(start, std::chrono::steady_clock::now()));
+        if (made)
+        {
+            writeWorldFrame(fused);
+        }
+    }
+    fusionStats.report();
+    std::cout << worldFusion->framesFused() << " world frames written to \"" << worldOutputPath << "\"\n";
+    if (worldFusion->lateViews() > 0)
+    {
+        std::cout << worldFusion->lateViews() << " files were older than a file of the same camera written before them and were left out\n";
+    }
+    return true;
+}//runOfflineWorldFusion()
+
+
+
+//The people of a binary keypoint file as the JSON WorldFusion reads, one *_keypoints_3d array per part in its layout
+void binaryToJson(const BinaryKeypointFrame& binary, json& document)
+{
+    document = json::object();
+    json& people = document["people"];
+    people = json::array();
+    for (uint32_t i = 0; i < binary.people; i++)
+    {
+        json person = json::object();
+        for (int part = 0; part < KEYPOINT_PART_COUNT; part++)
+        {
+            if (binary.partKeypoints[part] > 0)
+            {
+                const float* points = binary.person(i) + 4 * binary.partStart(part);
+                person[std::string(keypointParts[part]) + "_keypoints_3d"] = std::vector<float>(points, points + 4 * binary.partKeypoints[part]);
+            }
+        }
+        people.push_back(std::move(person));
+    }
+}//binaryToJson()
+
+
+
+//Milliseconds since 1970, the time base world fusion compares views in
+double toMilliseconds(std::chrono::system_clock::time_point time)
+{
+    return std::chrono::duration<double, std::milli>(time.time_since_epoch()).count();
+}//toMilliseconds()
+
+
+
+//Gets the depth in meters behind a color pixel from the raw depth frame (sparse) or from depth already aligned to the
+//  color image by DepthAligner (full) or rs2::align (sdk)
+float getKeypointDepth(const CameraContext& camera, const uint16_t* depthData, const float pixel[2])
+{
+    if (registrationMode == REGISTRATION_SPARSE)
+    {
+        return camera.sparseRegistration->depthAtColorPixel(depthData, pixel);
+    }
+    else
+    {
+        return depthData[(int)pixel[1] * camera.colorIntrinsics.width + (int)pixel[0]] * camera.depthScale;
+    }
+}//getKeypointDepth()
+
+
+
+//Compares DepthAligner's latest output with rs2::align's for the same depth frame and prints a running total (of all cameras)
+void checkAlignment(const CameraContext& camera, const rs2::depth_frame& sdkAligned)
+{
+    static long long framesChecked = 0;
+    static long long pixelsDifferent = 0;
+    static int largestDifference = 0;
+
+    const uint8_t* sdkData = (const uint8_t*)sdkAligned.get_data();
+    int sdkStride = sdkAligned.get_stride_in_bytes();
+
+    for (int y = 0; y < camera.colorIntrinsics.height; y++)
+    {
+        const uint16_t* sdkRow = (const uint16_t*)(sdkData + y * sdkStride);
+        const uint16_t* ownRow = camera.alignedDepth.data() + y * camera.colorIntrinsics.width;
+        for (int x = 0; x < camera.colorIntrinsics.width; x++)
+        {
+            if (sdkRow[x] != ownRow[x])
+            {
+                pixelsDifferent++;
+                largestDifference = std::max(largestDifference, std::abs(sdkRow[x] - ownRow[x]));
+            }
+        }
+    }
+    framesChecked++;
+
+    if (framesChecked % 30 == 0) //About once a second
+    {
+        std::cout << "Alignment check: " << framesChecked << " frames, " << pixelsDifferent << " pixels differ from rs2::align"
+            << " (largest difference " << largestDifference << " depth units)\n";
+    }
+}//checkAlignment()
+
+
+
+//Starts playing a recording's depth and color streams once through, not in real time, so no frame is skipped while the
+//  frames are checked or timed
+rs2::pipeline_profile startReplay(rs2::pipeline& pipe, const std::string& bagFile)
+{
+    rs2::config cfg;
+    cfg.enable_device_from_file(bagFile, false); //Once through, no repeat
+    cfg.enable_stream(RS2_STREAM_DEPTH, depthWidth, depthHeight, RS2_FORMAT_Z16, 30);
+    cfg.enable_stream(RS2_STREAM_COLOR, colorWidth, colorHeight, RS2_FORMAT_BGR8, 30);
+    rs2::pipeline_profile profile = pipe.start(cfg);
+    profile.get_device().as<rs2::playback>().set_real_time(false);
+    return profile;
+}//startReplay()
+
+
+
+//Plays back the recording of the first camera frame by frame, as fast as it can be checked, and aligns every depth
+//  frame with each DepthAligner path this CPU has (and tiled across threads=) and with rs2::align on the recorded
+//  color frame. Every frame with a difference is printed. The fastest path is also timed tiled on 1, 2, 4, and 8
+//  threads, and the speed-up of each over 1 thread is printed. Returns false if there was any difference (including
+//  between thread counts), or no frames at all.
+bool runAlignmentReplay()
+{
+    CameraContext& camera = *cameras[0];
+    if (camera.bagFile.empty())
+    {
+        std::cout << "verify=replay needs a recording, bag=<path\\to\\recording.bag>.\n";
+        return false;
+    }
+
+    rs2::pipeline pipe;
+    rs2::pipeline_profile profile = startReplay(pipe, camera.bagFile);
+    rs2::video_stream_profile depthProfile = profile.get_stream(RS2_STREAM_DEPTH).as<rs2::video_stream_profile>();
+    rs2::video_stream_profile colorProfile = profile.get_stream(RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
+    rs2_intrinsics depthIntrinsics = depthProfile.get_intrinsics();
+    rs2_intrinsics colorIntrinsics = colorProfile.get_intrinsics();
+    rs2_extrinsics depth2Color = depthProfile.get_extrinsics_to(colorProfile);
+    float depthScale = profile.get_device().first<rs2::depth_sensor>().get_depth_scale();
+
+    std::vector<DepthAligner*> aligners; //Each path once, the fastest also tiled
+    for (AlignPath path : { ALIGN_SCALAR, ALIGN_SSE2, ALIGN_AVX2 })
+    {
+        DepthAligner* aligner = new DepthAligner(depthIntrinsics, colorIntrinsics, depth2Color, depthScale, path);
+        if (aligner->path() != path) //Not on this CPU, or not for this color model
+        {
+            delete aligner;
+            continue;
+        }
+        aligners.push_back(aligner);
+    }
+    WorkerPool pool(alignThreads);
+    std::cout << "Checking " << camera.bagFile << " against rs2::align with";
+    for (DepthAligner* aligner : aligners)
+    {
+        std::cout << " " << alignPathNames[aligner->path()];
+    }
+    std::cout << ", and " << alignPathNames[aligners.back()->path()] << " tiled on " << alignThreads << " thread(s)\n";
+    const int scalingThreads[] = { 1, 2, 4, 8 };
+    std::vector<WorkerPool*> scalingPools;
+    for (int threads : scalingThreads)
+    {
+        scalingPools.push_back(new WorkerPool(threads));
+    }
+    std::vector<double> scalingMs(scalingPools.size(), 0.0); //Total of each thread count
+
+    rs2::align align(RS2_STREAM_COLOR);
+    DepthSlot depth;
+    depth.allocate(depthIntrinsics.width, depthIntrinsics.height);
+    std::vector<uint16_t> aligned((size_t)colorIntrinsics.width * colorIntrinsics.height);
+    std::vector<uint16_t> scaled(aligned.size());
+    long long frames = 0;
+    long long framesDifferent = 0;
+    rs2::frameset frameset;
+    while (pipe.try_wait_for_frames(&frameset, 5000)) //Times out once the recording has ended
+    {
+        if (!frameset.get_depth_frame() || !frameset.get_color_frame())
+        {
+            continue;
+        }
+        depth.copyFrom(frameset.get_depth_frame(), std::chrono::system_clock::now()); //Without row padding, like the live path
+        rs2::depth_frame sdkAligned = align.process(frameset).get_depth_frame();
+        const uint8_t* sdkData = (const uint8_t*)sdkAligned.get_data();
+        int sdkStride = sdkAligned.get_stride_in_bytes();
+        frames++;
+
+        bool frameDifferent = false;
+        for (size_t i = 0; i <= aligners.size(); i++)
+        {
+            DepthAligner* aligner = aligners[std::min(i, aligners.size() - 1)];
+            if (i < aligners.size())
+            {
+                aligner->align(depth.depth.data(), aligned.data());
+            }
+            else
+            {
+                aligner->alignTiled(depth.depth.data(), aligned.data(), pool);
+            }
+
+            long long pixelsDifferent = 0;
+            int largestDifference = 0;
+            for (int y = 0; y < colorIntrinsics.height; y++)
+            {
+                const uint16_t* sdkRow = (const uint16_t*)(sdkData + y * sdkStride);
+                const uint16_t* ownRow = aligned.data() + y * colorIntrinsics.width;
+                for (int x = 0; x < colorIntrinsics.width; x++)
+                {
+                    if (sdkRow[x] != ownRow[x])
                     {
-                        //Set the values to 0
-                        tempFace3d[4 * j] = 0;
-                        tempFace3d[4 * j + 1] = 0;
-                        tempFace3d[4 * j + 2] = 0;
-                        tempFace3d[4 * j + 3] = 0; // "Confidence" = 0
+                        pixelsDifferent++;
+                        largestDifference = std::max(largestDifference, std::abs(sdkRow[x] - ownRow[x]));
                     }
-                }//For all 69 Face keypoints
+                }
             }
-            catch(...)
+            if (pixelsDifferent > 0)
             {
-                insertFace = false;
+                frameDifferent = true;
+                std::cout << "Frame " << frameset.get_depth_frame().get_frame_number() << ", " << alignPathNames[aligner->path()]
+                    << (i < aligners.size() ? "" : " tiled") << ": " << pixelsDifferent << " pixels differ (largest difference "
+                    << largestDifference << " depth units)\n";
             }
+        }
 
-            //Insert the 3D points into this person
-            jsn["people"][i]["pose_keypoints_3d"] = tempPose3d;
-            if (insertFace)
+        //The same tiled alignment timed on each thread count, which must not change the result
+        for (size_t p = 0; p < scalingPools.size(); p++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            aligners.back()->alignTiled(depth.depth.data(), scaled.data(), *scalingPools[p]);
+            scalingMs[p] += elapsedMs(start, std::chrono::steady_clock::now());
+            if (!std::equal(scaled.begin(), scaled.end(), aligned.begin()))
             {
-                jsn["people"][i]["face_keypoints_3d"] = tempFace3d;
-            }    
-			if (insertHand)
-			{
-				jsn["people"][i]["hand_left_keypoints_3d"] = tempLeftHand3d;
-				jsn["people"][i]["hand_right_keypoints_3d"] = tempRightHand3d;
-			}
-        }//For all people
+                frameDifferent = true;
+                std::cout << "Frame " << frameset.get_depth_frame().get_frame_number() << ", " << alignPathNames[aligners.back()->path()] << " tiled on "
+                    << scalingThreads[p] << " thread(s) differs from " << alignThreads << " thread(s)\n";
+            }
+        }
+        if (frameDifferent)
+        {
+            framesDifferent++;
+        }
+    }//Until the recording ends
+    pipe.stop();
+
+    if (frames > 0)
+    {
+        std::cout << alignPathNames[aligners.back()->path()] << " tiled, mean per frame (" << std::thread::hardware_concurrency() << " hardware threads):";
+        for (size_t p = 0; p < scalingPools.size(); p++)
+        {
+            std::cout << (p == 0 ? " " : ", ") << scalingThreads[p] << " thread(s) " << scalingMs[p] / frames << " ms (" << scalingMs[0] / scalingMs[p] << "x)";
+        }
+        std::cout << "\n";
+    }
+    for (WorkerPool* scalingPool : scalingPools)
+    {
+        delete scalingPool;
+    }
+    for (DepthAligner* aligner : aligners)
+    {
+        delete aligner;
+    }
+    std::cout << "Alignment check: " << frames << " frames, " << framesDifferent << " with differences from rs2::align\n";
+    return frames > 0 && framesDifferent == 0;
+}//runAlignmentReplay()
 
-        //Save the updated file
-        fileName.insert(23, sizeof(char), 'D'); //Place a D for depth/done at the end of the file name
-        std::ofstream output(OpenPoseOutPath + fileName);
-        output << std::setw(4) << jsn << std::endl;
-        output.close();
 
-        frameNumber++;
-    }//Else the file was loaded
-}//updateKeypoints()
+
+//Plays back the recording of the first camera and times both ways of finding the depth behind the same keypoints on
+//  every depth frame: align=sdk (the software device, its syncer and rs2::align on the first color frame, then a lookup
+//  per keypoint) and align=sparse (a search of each keypoint's epipolar segment in the raw depth frame). The keypoints
+//  are those of a synthetic 5 person file (see makeKeypointFile()), scaled to the recorded color size. Both start from
+//  the same copy of the depth frame, like the live path. Returns false without a recording or any frames.
+bool runRegistrationBenchmark()
+{
+    CameraContext& camera = *cameras[0];
+    if (camera.bagFile.empty())
+    {
+        std::cout << "benchmark=replay needs a recording, bag=<path\\to\\recording.bag>.\n";
+        return false;
+    }
+
+    rs2::pipeline pipe;
+    rs2::pipeline_profile profile = startReplay(pipe, camera.bagFile);
+    rs2::video_stream_profile depthProfile = profile.get_stream(RS2_STREAM_DEPTH).as<rs2::video_stream_profile>();
+    rs2::video_stream_profile colorProfile = profile.get_stream(RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
+    rs2_intrinsics depthIntrinsics = depthProfile.get_intrinsics();
+    rs2_intrinsics colorIntrinsics = colorProfile.get_intrinsics();
+    rs2_extrinsics depth2Color = depthProfile.get_extrinsics_to(colorProfile);
+    float depthScale = profile.get_device().first<rs2::depth_sensor>().get_depth_scale();
+
+    DepthRayTable rays(depthIntrinsics, depth2Color);
+    SparseRegistration sparse(rays, depthIntrinsics, colorIntrinsics, depth2Color, depthScale);
+    SdkAligner* sdkAligner = nullptr; //Made on the first color frame, which stays its baseline like the warm-up's
+
+    KeypointFile file;
+    std::string error;
+    std::string text = makeKeypointFile(5);
+    readKeypoints(text.data(), text.size(), file, error);
+    std::vector<float> pixels; //u, v of every keypoint OpenPose found
+    for (size_t i = 0; i < file.people(); i++)
+    {
+        for (int part = 0; part < KEYPOINT_PART_COUNT; part++)
+        {
+            const double* values = file.part(i, part);
+            for (size_t j = 0; j + 2 < file.partValues(i, part); j += 3)
+            {
+                if (values[j + 2] > 0)
+                {
+                    pixels.push_back((float)(values[j] * colorIntrinsics.width / 1920.0));
+                    pixels.push_back((float)(values[j + 1] * colorIntrinsics.height / 1080.0));
+                }
+            }
+        }
+    }
+    size_t keypoints = pixels.size() / 2;
+    std::cout << "Timing align=sdk against align=sparse on " << camera.bagFile << " with " << keypoints << " keypoints per frame\n";
+
+    LatencyStats sdkStats("align=sdk per frame");
+    LatencyStats sparseStats("align=sparse per frame");
+    DepthSlot depth;
+    depth.allocate(depthIntrinsics.width, depthIntrinsics.height);
+    rs2::depth_frame sdkAligned = rs2::frame(); //depth_frame has no default constructor
+    std::vector<float> sdkDepths(keypoints);
+    std::vector<float> sparseDepths(keypoints);
+    long long frames = 0;
+    long long sdkFound = 0; //Keypoints with depth
+    long long sparseFound = 0;
+    long long disagreeing = 0; //Keypoints both found depth for, more than 1 cm apart
+    rs2::frameset frameset;
+    while (pipe.try_wait_for_frames(&frameset, 5000)) //Times out once the recording has ended
+    {
+        if (!frameset.get_depth_frame() || !frameset.get_color_frame())
+        {
+            continue;
+        }
+        if (sdkAligner == nullptr)
+        {
+            sdkAligner = new SdkAligner(depthIntrinsics, colorIntrinsics, depth2Color, depthScale, frameset.get_color_frame());
+        }
+        depth.copyFrom(frameset.get_depth_frame(), std::chrono::system_clock::now());
+
+        auto start = std::chrono::steady_clock::now();
+        if (!sdkAligner->process(depth.depth.data(), depth.hardwareTimestamp, sdkAligned)) //The syncer is still filling up
+        {
+            continue;
+        }
+        const uint16_t* sdkData = (const uint16_t*)sdkAligned.get_data();
+        for (size_t k = 0; k < keypoints; k++)
+        {
+            sdkDepths[k] = sdkData[(int)pixels[2 * k + 1] * colorIntrinsics.width + (int)pixels[2 * k]] * depthScale;
+        }
+        auto sdkEnd = std::chrono::steady_clock::now();
+        for (size_t k = 0; k < keypoints; k++)
+        {
+            sparseDepths[k] = sparse.depthAtColorPixel(depth.depth.data(), &pixels[2 * k]);
+        }
+        auto sparseEnd = std::chrono::steady_clock::now();
+        sdkStats.add(elapsedMs(start, sdkEnd));
+        sparseStats.add(elapsedMs(sdkEnd, sparseEnd));
+        frames++;
+
+        for (size_t k = 0; k < keypoints; k++)
+        {
+            sdkFound += sdkDepths[k] > 0;
+            sparseFound += sparseDepths[k] > 0;
+            disagreeing += sdkDepths[k] > 0 && sparseDepths[k] > 0 && std::fabs(sdkDepths[k] - sparseDepths[k]) > 0.01f;
+        }
+    }//Until the recording ends
+    pipe.stop();
+    delete sdkAligner;
+
+    sdkStats.report();
+    sparseStats.report();
+    if (frames > 0)
+    {
+        std::cout << "Keypoints with depth per frame: align=sdk " << (double)sdkFound / frames << ", align=sparse " << (double)sparseFound / frames
+            << ", " << (double)disagreeing / frames << " more than 1 cm apart\n";
+    }
+    return frames > 0;
+}//runRegistrationBenchmark()
 
 
 //Converts floats to their nearest integer value
@@ -506,6 +1907,16 @@ int f2i(double x)
 
 
 
+//Reads "true", "t", "yes", "y", or "1" (any case) as true, like launch.py
+bool isTrue(const std::string& value)
+{
+    std::string lower(value);
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    return lower == "true" || lower == "t" || lower == "yes" || lower == "y" || lower == "1";
+}//isTrue()
+
+
+
 //Accepts anything as input to pause the program so that error messages can be read
 void press2Close()
 {
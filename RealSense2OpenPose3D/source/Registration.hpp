@@ -0,0 +1,151 @@
+//Sparse depth registration for RealSense to OpenPose 3D
+//
+//Finds the depth behind single color pixels without aligning the whole depth frame to the color frame.
+//  A color pixel is deprojected at the nearest and farthest usable depths and both points are projected into the
+//  depth image. Whatever surface the color pixel sees must lie on the line between those two depth pixels (the
+//  epipolar segment), so only that line is searched for depth pixels that project back onto the color pixel.
+//  The depth pixels on the segment are sent back into color space through a DepthRayTable.
+//The search is compiled once per color distortion model and the constructor picks the one matching the camera. The
+//  depth model is only used for the two ends of the segment, so it stays a run time check.
+//Based on rs2_project_color_pixel_to_depth_pixel() from librealsense's rsutil.h
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include <librealsense2/rs.hpp>
+#include <librealsense2/rsutil.h>
+
+#include "./Deprojection.hpp" //Depth pixel rays
+#include "./Distortion.hpp" //Per model projection
+
+
+class SparseRegistration
+{
+public:
+    SparseRegistration(const DepthRayTable& depthRays, const rs2_intrinsics& depthIntrin, const rs2_intrinsics& colorIntrin,
+        const rs2_extrinsics& depth2ColorExtrin, float depthUnits, float nearLimit = 0.1f, float farLimit = 10.0f);
+
+    //Depth in meters behind a color pixel, 0 if nothing was found
+    float depthAtColorPixel(const uint16_t* depthData, const float colorPixel[2]) const
+    {
+        return (this->*search)(depthData, colorPixel);
+    }
+
+private:
+    template <rs2_distortion ColorModel>
+    float searchSegment(const uint16_t* depthData, const float colorPixel[2]) const;
+
+    float (SparseRegistration::*search)(const uint16_t* depthData, const float colorPixel[2]) const; //searchSegment() for the color model
+
+    const DepthRayTable& rays; //Built once at startup and shared
+    rs2_intrinsics depthIntrinsics;
+    rs2_intrinsics colorIntrinsics;
+    rs2_extrinsics depth2Color;
+    rs2_extrinsics color2Depth; //Inverse of depth2Color, used to find the ends of the epipolar segment
+    float depthScale; //Meters per Z16 unit
+    float minDepth; //Search range in meters
+    float maxDepth;
+    float matchRadius; //How far (in color pixels) a projected depth pixel may land from the color pixel and still cover it
+};
+
+
+
+inline SparseRegistration::SparseRegistration(const DepthRayTable& depthRays, const rs2_intrinsics& depthIntrin, const rs2_intrinsics& colorIntrin,
+    const rs2_extrinsics& depth2ColorExtrin, float depthUnits, float nearLimit, float farLimit)
+    : rays(depthRays), depthIntrinsics(depthIntrin), colorIntrinsics(colorIntrin), depth2Color(depth2ColorExtrin),
+      depthScale(depthUnits), minDepth(nearLimit), maxDepth(farLimit)
+{
+    //Invert the extrinsics (rotations are column-major, so the transpose is a swap of the row and column indices)
+    for (int row = 0; row < 3; row++)
+    {
+        for (int col = 0; col < 3; col++)
+        {
+            color2Depth.rotation[col * 3 + row] = depth2Color.rotation[row * 3 + col];
+        }
+    }
+    for (int row = 0; row < 3; row++)
+    {
+        color2Depth.translation[row] = -(color2Depth.rotation[row] * depth2Color.translation[0]
+            + color2Depth.rotation[3 + row] * depth2Color.translation[1]
+            + color2Depth.rotation[6 + row] * depth2Color.translation[2]);
+    }
+
+    //One depth pixel covers roughly this many color pixels, rs2::align fills that whole footprint with its depth
+    float footprint = std::max(colorIntrinsics.fx / depthIntrinsics.fx, colorIntrinsics.fy / depthIntrinsics.fy);
+    matchRadius = 0.5f * footprint + 0.5f; //Half of the footprint plus half of the color pixel itself
+
+    switch (colorIntrinsics.model) //The only time the color model is checked
+    {
+    case RS2_DISTORTION_NONE: search = &SparseRegistration::searchSegment<RS2_DISTORTION_NONE>; break;
+    case RS2_DISTORTION_BROWN_CONRADY: search = &SparseRegistration::searchSegment<RS2_DISTORTION_BROWN_CONRADY>; break;
+    case RS2_DISTORTION_INVERSE_BROWN_CONRADY: search = &SparseRegistration::searchSegment<RS2_DISTORTION_INVERSE_BROWN_CONRADY>; break;
+    case RS2_DISTORTION_KANNALA_BRANDT4: search = &SparseRegistration::searchSegment<RS2_DISTORTION_KANNALA_BRANDT4>; break;
+    default: search = &SparseRegistration::searchSegment<ANY_DISTORTION>; break;
+    }
+}//SparseRegistration()
+
+
+
+//Walks the epipolar segment of a color pixel through the depth image and returns the nearest depth whose pixel covers
+//  the color pixel. Taking the nearest one mirrors the z-buffer that rs2::align uses when several depth pixels land on
+//  the same color pixel.
+template <rs2_distortion ColorModel>
+inline float SparseRegistration::searchSegment(const uint16_t* depthData, const float colorPixel[2]) const
+{
+    float colorPoint[3], depthPoint[3]; //Temp points for finding the ends of the segment
+    float startPixel[2], endPixel[2];
+
+    deprojectPixel<ColorModel>(colorPoint, colorIntrinsics, colorPixel, minDepth); //Nearest possible point
+    rs2_transform_point_to_point(depthPoint, &color2Depth, colorPoint);
+    rs2_project_point_to_pixel(startPixel, &depthIntrinsics, depthPoint);
+
+    deprojectPixel<ColorModel>(colorPoint, colorIntrinsics, colorPixel, maxDepth); //Farthest possible point
+    rs2_transform_point_to_point(depthPoint, &color2Depth, colorPoint);
+    rs2_project_point_to_pixel(endPixel, &depthIntrinsics, depthPoint);
+
+    float deltaX = endPixel[0] - startPixel[0];
+    float deltaY = endPixel[1] - startPixel[1];
+    int steps = (int)std::ceil(std::max(std::fabs(deltaX), std::fabs(deltaY))); //One step per depth pixel along the longer axis
+    if (steps < 1)
+    {
+        steps = 1;
+    }
+
+    float bestDepth = 0; //0 means no depth pixel covered the color pixel
+    float projected[2];
+
+    for (int step = 0; step <= steps; step++) //For every depth pixel on the segment
+    {
+        int x = (int)std::floor(startPixel[0] + deltaX * step / steps + 0.5f); //Round to the nearest depth pixel
+        int y = (int)std::floor(startPixel[1] + deltaY * step / steps + 0.5f);
+
+        if (x < 0 || y < 0 || x >= depthIntrinsics.width || y >= depthIntrinsics.height) //Parts of the segment may leave the depth image
+        {
+            continue;
+        }
+
+        int index = y * depthIntrinsics.width + x;
+        float depth = depthData[index] * depthScale;
+        if (depth < minDepth || depth > maxDepth) //No data (0) or outside the search range
+        {
+            continue;
+        }
+
+        //Send the depth pixel back into the color image and see if it lands on the color pixel
+        rays.toColorPoint(index, depth, colorPoint);
+        projectPoint<ColorModel>(projected, colorIntrinsics, colorPoint);
+
+        if (std::fabs(projected[0] - colorPixel[0]) <= matchRadius && std::fabs(projected[1] - colorPixel[1]) <= matchRadius)
+        {
+            if (bestDepth == 0 || depth < bestDepth) //Keep the nearest surface
+            {
+                bestDepth = depth;
+            }
+        }
+    }//For every depth pixel on the segment
+
+    return bestDepth;
+}//searchSegment()
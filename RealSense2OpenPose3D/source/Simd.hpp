@@ -0,0 +1,40 @@
+//SIMD support for RealSense to OpenPose 3D
+//
+//AVX2 code is compiled into every x86 build and only used when cpuHasAvx2() says the machine can run it, so one
+//  exe works on every PC. MSVC accepts AVX2 intrinsics without /arch:AVX2, GCC and Clang need each AVX2 function
+//  marked with SIMD_AVX2. SSE2 is part of every x64 CPU, so SSE2 code (SIMD_SSE2) needs no check and is the fallback
+//  for machines without AVX2.
+
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIMD_AVX2
+#else
+#include <cpuid.h>
+#define SIMD_AVX2 __attribute__((target("avx2")))
+#endif
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define SIMD_SSE2
+#endif
+#endif
+
+
+//Checks if both the CPU and the OS support AVX2
+inline bool cpuHasAvx2()
+{
+#if defined(SIMD_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6); //OSXSAVE, AVX, and YMM state enabled
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1 << 5));
+#elif defined(SIMD_X86)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}//cpuHasAvx2()
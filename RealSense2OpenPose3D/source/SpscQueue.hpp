@@ -0,0 +1,69 @@
+//Single producer, single consumer queue for RealSense to OpenPose 3D
+//
+//A fixed size ring of small trivially copyable items (buffer indices) that one thread pushes to and another pops from
+//  without locks. push() is wait-free. pop() claims items with a compare-and-swap so the producer may also pop,
+//  which is how it throws away the oldest item when the consumer falls behind; that CAS is the only place the two
+//  threads can contend. head and tail count every push and pop ever made and are only wrapped to a slot when indexing,
+//  so a pop that loaded its item before the other side popped, refilled, and came back around to the same slot still
+//  fails its CAS instead of taking the slot a second time (ABA).
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+
+template <class T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(int capacity)
+        : size((size_t)capacity), items(new std::atomic<T>[(size_t)capacity]), head(0), tail(0)
+    {
+    }
+
+    //Producer only. False if the queue is full.
+    bool push(T item)
+    {
+        size_t write = tail.load(std::memory_order_relaxed);
+        if (write - head.load(std::memory_order_acquire) >= size)
+        {
+            return false;
+        }
+        items[write % size].store(item, std::memory_order_relaxed);
+        tail.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    //Consumer, or the producer dropping the oldest item. False if the queue is empty.
+    bool pop(T& item)
+    {
+        size_t read = head.load(std::memory_order_acquire);
+        while (read != tail.load(std::memory_order_acquire))
+        {
+            item = items[read % size].load(std::memory_order_relaxed);
+            if (head.compare_exchange_weak(read, read + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                return true;
+            }
+            //The other side took it first, read now holds the new head
+        }
+        return false;
+    }
+
+    int count() const //Only a snapshot while the other thread is running
+    {
+        size_t write = tail.load(std::memory_order_acquire);
+        size_t read = head.load(std::memory_order_acquire);
+        return (int)(write - read);
+    }
+
+    int capacity() const { return (int)size; }
+
+private:
+    const size_t size;
+    std::unique_ptr<std::atomic<T>[]> items;
+    std::atomic<size_t> head; //Items popped so far, the next one is in items[head % size]
+    std::atomic<size_t> tail; //Items pushed so far, the next one goes in items[tail % size]
+};
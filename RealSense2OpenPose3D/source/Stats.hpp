@@ -0,0 +1,78 @@
+//Timing statistics for RealSense to OpenPose 3D
+//
+//LatencyStats collects per-frame timings (or counts, with a different unit) and prints the mean, median, 99th percentile, and maximum every so many
+//  frames, so the different registration modes can be compared on the same machine.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+class LatencyStats
+{
+public:
+    explicit LatencyStats(const std::string& statName, int framesPerReport = 300, const std::string& statUnit = "ms")
+        : name(statName), unit(statUnit), reportEvery(framesPerReport)
+    {
+        samples.reserve(framesPerReport);
+    }
+
+    void add(double value); //Records one frame and prints a report when enough frames have been collected
+    void report(); //Prints the collected frames and starts over
+
+private:
+    std::mutex mutex; //Output stage threads may add at the same time
+    std::string name;
+    std::string unit; //Printed after every value, milliseconds unless something else is being counted
+    int reportEvery;
+    std::vector<double> samples;
+};
+
+
+
+//Milliseconds between two time points of the same clock
+template <class TimePoint>
+inline double elapsedMs(TimePoint start, TimePoint end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}//elapsedMs()
+
+
+
+inline void LatencyStats::add(double value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    samples.push_back(value);
+    if ((int)samples.size() >= reportEvery)
+    {
+        report();
+    }
+}//add()
+
+
+
+inline void LatencyStats::report()
+{
+    if (samples.empty())
+    {
+        return;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    double total = 0;
+    for (double sample : samples)
+    {
+        total += sample;
+    }
+
+    std::cout << name << ": mean " << total / samples.size() << " " << unit << ", median " << samples[samples.size() / 2]
+        << " " << unit << ", 99th percentile " << samples[(samples.size() * 99) / 100] << " " << unit << ", max " << samples.back()
+        << " " << unit << " over " << samples.size() << " frames\n";
+
+    samples.clear();
+}//report()
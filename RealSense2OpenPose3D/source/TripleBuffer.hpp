@@ -0,0 +1,95 @@
+//Latest depth frame hand-off for RealSense to OpenPose 3D
+//
+//For handoff=latest the fusion thread never works through a queue, it only ever wants the newest depth frame.
+//  DepthTripleBuffer has three DepthSlots: the capture thread owns one to write into, the fusion thread owns one to
+//  read from, and the third sits in the middle holding the newest finished frame. Publishing and taking are each a
+//  single atomic exchange of the middle slot's index (plus a bit saying whether it is new), so neither thread ever
+//  waits for the other and the fusion thread reads the frame in place. Frames the fusion thread never took are simply
+//  overwritten and counted.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+#include <librealsense2/rs.hpp>
+
+#include "./DepthRingBuffer.hpp" //DepthSlot
+
+
+class DepthTripleBuffer
+{
+public:
+    DepthTripleBuffer(int depthWidth, int depthHeight);
+
+    //Capture thread
+    void publish(const rs2::depth_frame& depth, std::chrono::system_clock::time_point arrival);
+
+    //Fusion thread. The newest frame if it wasn't taken yet, otherwise nullptr. Stays valid until the next take().
+    const DepthSlot* take();
+
+    size_t memoryBytes() const { return 3 * slots[0].depth.size() * sizeof(uint16_t); }
+    void printCounters() const;
+
+private:
+    static const int NEW_FRAME = 4; //Set in middle while it holds a frame that hasn't been taken
+
+    DepthSlot slots[3];
+    int writing; //Capture thread's slot
+    int reading; //Fusion thread's slot
+    std::atomic<int> middle; //Slot index | NEW_FRAME
+
+    std::atomic<unsigned long long> framesPublished;
+    std::atomic<unsigned long long> framesOverwritten; //Published again before the fusion thread took them
+    std::atomic<unsigned long long> framesTaken;
+};
+
+
+
+inline DepthTripleBuffer::DepthTripleBuffer(int depthWidth, int depthHeight)
+    : writing(0), reading(1), middle(2), framesPublished(0), framesOverwritten(0), framesTaken(0)
+{
+    for (DepthSlot& slot : slots)
+    {
+        slot.allocate(depthWidth, depthHeight);
+    }
+}//DepthTripleBuffer()
+
+
+
+inline void DepthTripleBuffer::publish(const rs2::depth_frame& depth, std::chrono::system_clock::time_point arrival)
+{
+    slots[writing].copyFrom(depth, arrival);
+    int previous = middle.exchange(writing | NEW_FRAME, std::memory_order_acq_rel); //Swap the finished slot into the middle
+    writing = previous & ~NEW_FRAME; //And write into whatever was there next time
+
+    framesPublished++;
+    if (previous & NEW_FRAME)
+    {
+        framesOverwritten++;
+    }
+}//publish()
+
+
+
+inline const DepthSlot* DepthTripleBuffer::take()
+{
+    if ((middle.load(std::memory_order_relaxed) & NEW_FRAME) == 0) //Nothing new, skip the exchange
+    {
+        return nullptr;
+    }
+
+    int previous = middle.exchange(reading, std::memory_order_acq_rel); //Hand back the slot that was just read
+    reading = previous & ~NEW_FRAME;
+    framesTaken++;
+    return &slots[reading];
+}//take()
+
+
+
+inline void DepthTripleBuffer::printCounters() const
+{
+    std::cout << "Capture: " << framesPublished.load() << " frames published, " << framesOverwritten.load()
+        << " replaced before being used. Fusion: " << framesTaken.load() << " frames taken\n";
+}//printCounters()
@@ -0,0 +1,60 @@
+//Warm-up convergence for RealSense to OpenPose 3D
+//
+//Right after a stream starts, auto-exposure and gain hunt for a while: a few frames in a bright room, a few seconds in
+//  a dim one. ExposureConvergence follows one stream's frame metadata (actual exposure and gain level) and reports it
+//  settled once both have stayed within a small tolerance for several frames in a row. Without metadata (e.g. Windows
+//  without the metadata registry patch, or a recording) it can't tell, and the caller falls back to a fixed count.
+
+#pragma once
+
+#include <cmath>
+
+#include <librealsense2/rs.hpp>
+
+
+class ExposureConvergence
+{
+public:
+    explicit ExposureConvergence(int stableFramesNeeded = 5, double relativeTolerance = 0.02)
+        : stableNeeded(stableFramesNeeded), tolerance(relativeTolerance), stable(0), lastExposure(-1), lastGain(-1), metadata(true)
+    {
+    }
+
+    //Adds the stream's newest frame. True once exposure and gain have settled.
+    bool add(const rs2::frame& frame)
+    {
+        if (!frame || !frame.supports_frame_metadata(RS2_FRAME_METADATA_ACTUAL_EXPOSURE) || !frame.supports_frame_metadata(RS2_FRAME_METADATA_GAIN_LEVEL))
+        {
+            metadata = false;
+            return false;
+        }
+
+        double exposure = (double)frame.get_frame_metadata(RS2_FRAME_METADATA_ACTUAL_EXPOSURE);
+        double gain = (double)frame.get_frame_metadata(RS2_FRAME_METADATA_GAIN_LEVEL);
+        if (lastExposure >= 0 && close(exposure, lastExposure) && close(gain, lastGain))
+        {
+            stable++;
+        }
+        else
+        {
+            stable = 0;
+        }
+        lastExposure = exposure;
+        lastGain = gain;
+        return stable >= stableNeeded;
+    }
+
+    bool hasMetadata() const { return metadata; }
+    double exposure() const { return lastExposure; } //Microseconds
+    double gain() const { return lastGain; }
+
+private:
+    bool close(double value, double previous) const { return std::fabs(value - previous) <= tolerance * std::fabs(previous); }
+
+    int stableNeeded;
+    double tolerance;
+    int stable; //Frames in a row without a change
+    double lastExposure;
+    double lastGain;
+    bool metadata;
+};
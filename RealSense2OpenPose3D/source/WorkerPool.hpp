@@ -0,0 +1,219 @@
+//Work-stealing worker pool for RealSense to OpenPose 3D
+//
+//A set of threads that is started once and then reused for every frame, so splitting work across cores does not cost
+//  a thread start per frame. parallelFor() runs task indices 0 ... taskCount - 1 and returns once all of them are done.
+//  The calling thread works on tasks too, so a pool of size N starts N - 1 threads.
+//Each thread starts with its own contiguous share of the indices and takes them from the front. A thread that runs
+//  out steals the back half of whichever share has the most left, so uneven tasks (one person in the middle of a
+//  crowd with both hands and a face, the rest only half visible) still keep every thread busy. A share is a begin and
+//  end packed into one 64-bit atomic, so taking and stealing are each a single compare-and-swap.
+//Tasks only ever write their own results (by index), so the output is the same whichever thread ran what.
+//Only one parallelFor() runs at a time. If another thread already has the pool (several fusion threads sharing it),
+//  the call runs its tasks serially on the calling thread instead of waiting, since the cores are busy anyway.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class WorkerPool
+{
+public:
+    explicit WorkerPool(int threadCount);
+    ~WorkerPool();
+
+    //Runs task(0) ... task(taskCount - 1) and waits. Fewer than serialBelow tasks are run serially on the calling thread.
+    void parallelFor(int taskCount, const std::function<void(int task)>& task, int serialBelow = 2);
+
+    int size() const { return (int)workers.size() + 1; }
+
+private:
+    void workerLoop(int worker);
+    void runTasks(int worker);
+    bool takeTask(int worker, int& task); //From the front of the worker's own share
+    bool stealTasks(int worker); //Moves half of the fullest other share into the worker's own. False if there is nothing left.
+
+    static uint64_t packRange(uint32_t begin, uint32_t end) { return ((uint64_t)end << 32) | begin; }
+    static uint32_t rangeBegin(uint64_t range) { return (uint32_t)range; }
+    static uint32_t rangeEnd(uint64_t range) { return (uint32_t)(range >> 32); }
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<std::atomic<uint64_t>[]> shares; //Task indices left for each thread, the caller's is the last one
+    std::mutex callerMutex; //Held for a whole parallelFor()
+    std::mutex mutex;
+    std::condition_variable wake; //New tasks or shutting down
+    std::condition_variable done; //All workers finished the current tasks
+    const std::function<void(int)>* currentTask;
+    int generation; //Incremented for every parallelFor() so sleeping workers know there is something new
+    int busyWorkers;
+    bool stopping;
+};
+
+
+
+inline WorkerPool::WorkerPool(int threadCount)
+    : shares(new std::atomic<uint64_t>[threadCount < 1 ? 1 : threadCount]), currentTask(nullptr), generation(0), busyWorkers(0), stopping(false)
+{
+    for (int i = 0; i < (threadCount < 1 ? 1 : threadCount); i++)
+    {
+        shares[i].store(0);
+    }
+    for (int i = 1; i < threadCount; i++) //The caller is the first worker
+    {
+        workers.emplace_back(&WorkerPool::workerLoop, this, i - 1);
+    }
+}//WorkerPool()
+
+
+
+inline WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}//~WorkerPool()
+
+
+
+inline void WorkerPool::parallelFor(int taskCount, const std::function<void(int task)>& task, int serialBelow)
+{
+    std::unique_lock<std::mutex> caller(callerMutex, std::try_to_lock);
+    if (workers.empty() || taskCount <= 1 || taskCount < serialBelow || !caller.owns_lock()) //Nothing to share, or the pool is taken
+    {
+        for (int i = 0; i < taskCount; i++)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    //Hand every thread an even share, the rest is balanced by stealing
+    int threads = size();
+    for (int i = 0; i < threads; i++)
+    {
+        shares[i].store(packRange((uint32_t)((long long)taskCount * i / threads), (uint32_t)((long long)taskCount * (i + 1) / threads)));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentTask = &task;
+        busyWorkers = (int)workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    runTasks(threads - 1); //Help out
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busyWorkers == 0; });
+    currentTask = nullptr;
+}//parallelFor()
+
+
+
+inline void WorkerPool::workerLoop(int worker)
+{
+    int seenGeneration = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping)
+            {
+                return;
+            }
+            seenGeneration = generation;
+        }
+
+        runTasks(worker);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyWorkers--;
+        }
+        done.notify_one();
+    }
+}//workerLoop()
+
+
+
+//Works through the thread's own share, then steals until every share is empty
+inline void WorkerPool::runTasks(int worker)
+{
+    int task;
+    do
+    {
+        while (takeTask(worker, task))
+        {
+            (*currentTask)(task);
+        }
+    } while (stealTasks(worker));
+}//runTasks()
+
+
+
+inline bool WorkerPool::takeTask(int worker, int& task)
+{
+    uint64_t range = shares[worker].load(std::memory_order_acquire);
+    while (rangeBegin(range) < rangeEnd(range))
+    {
+        if (shares[worker].compare_exchange_weak(range, packRange(rangeBegin(range) + 1, rangeEnd(range)), std::memory_order_acq_rel))
+        {
+            task = (int)rangeBegin(range);
+            return true;
+        }
+        //A thief took some of it, range now holds what is left
+    }
+    return false;
+}//takeTask()
+
+
+
+inline bool WorkerPool::stealTasks(int worker)
+{
+    int threads = size();
+    while (true)
+    {
+        //The share with the most left is the least likely to run out while it is being split
+        int victim = -1;
+        uint64_t victimRange = 0;
+        uint32_t most = 0;
+        for (int i = 0; i < threads; i++)
+        {
+            uint64_t range = shares[i].load(std::memory_order_acquire);
+            uint32_t left = rangeEnd(range) > rangeBegin(range) ? rangeEnd(range) - rangeBegin(range) : 0;
+            if (i != worker && left > most)
+            {
+                victim = i;
+                victimRange = range;
+                most = left;
+            }
+        }
+        if (victim < 0) //Everything is taken. Tasks in the middle of being stolen are run by their thief.
+        {
+            return false;
+        }
+
+        uint32_t split = rangeEnd(victimRange) - (most + 1) / 2; //The back half, rounded up so a last task can be stolen
+        if (shares[victim].compare_exchange_strong(victimRange, packRange(rangeBegin(victimRange), split), std::memory_order_acq_rel))
+        {
+            shares[worker].store(packRange(split, rangeEnd(victimRange)), std::memory_order_release); //Own share is empty, nobody else writes it
+            return true;
+        }
+        //The victim or another thief got there first, look again
+    }
+}//stealTasks()
@@ -0,0 +1,369 @@
+//Multi-view world frame fusion for RealSense to OpenPose 3D
+//
+//Every camera's keypoints come out in its own color camera's coordinates. WorldFusion moves them into one shared
+//  world frame with each camera's stored pose (camera to world extrinsics, see loadCameraPoses()), matches the people
+//  seen by the different cameras, and merges each joint as a confidence weighted average.
+//Views arrive one keypoint file at a time. The latest view of every camera is kept, and each view from the reference
+//  camera (the first one) produces a world frame from it and the other cameras' latest views taken within the time
+//  window. People are matched greedily, closest pair first, by the average distance between the joints both of them
+//  have; a person no other camera matched starts a person of their own. All of it is a few thousand multiply-adds per
+//  view, far less than the parsing around it.
+//With more than one fusion thread, two files of the same camera can reach WorldFusion out of order. A view older than
+//  the one already kept for its camera is dropped (and counted), so a late file never replaces a newer view.
+//It only depends on the JSON it is given, so the same code runs live (as a pipeline stage) and offline over recorded
+//  per-camera files.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <librealsense2/rs.hpp>
+#include <librealsense2/rsutil.h> //rs2_transform_point_to_point()
+
+#include "./json.hpp"
+
+
+//Reads each camera's pose from a JSON file like
+//  { "cameras": [ { "name": "<serial or recording.bag>", "rotation": [9 numbers], "translation": [x, y, z] } ] }
+//  where rotation is column-major like rs2_extrinsics and translation is in meters, taking color camera coordinates to
+//  the world. Returns false, after saying why, unless every name has a pose.
+inline bool loadCameraPoses(const std::string& path, const std::vector<std::string>& names, std::vector<rs2_extrinsics>& poses)
+{
+    std::ifstream file(path);
+    if (!file.good())
+    {
+        std::cout << "The camera pose file \"" << path << "\" could not be opened.\n";
+        return false;
+    }
+
+    nlohmann::json document;
+    try
+    {
+        document = nlohmann::json::parse(file);
+    }
+    catch (const nlohmann::json::exception& e)
+    {
+        std::cout << "The camera pose file \"" << path << "\" is not valid JSON: " << e.what() << "\n";
+        return false;
+    }
+
+    poses.assign(names.size(), rs2_extrinsics());
+    std::vector<bool> found(names.size(), false);
+    for (const nlohmann::json& camera : document["cameras"])
+    {
+        auto name = std::find(names.begin(), names.end(), camera.value("name", std::string()));
+        if (name == names.end())
+        {
+            continue; //A camera that isn't used this time
+        }
+        if (!camera.contains("rotation") || !camera.contains("translation") || camera["rotation"].size() != 9 || camera["translation"].size() != 3)
+        {
+            std::cout << "The pose of \"" << *name << "\" needs 9 rotation and 3 translation values.\n";
+            return false;
+        }
+
+        size_t index = name - names.begin();
+        for (int i = 0; i < 9; i++)
+        {
+            poses[index].rotation[i] = camera["rotation"][i].get<float>();
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            poses[index].translation[i] = camera["translation"][i].get<float>();
+        }
+        found[index] = true;
+    }
+
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        if (!found[i])
+        {
+            std::cout << "The camera pose file \"" << path << "\" has no pose for \"" << names[i] << "\".\n";
+            return false;
+        }
+    }
+    return true;
+}//loadCameraPoses()
+
+
+
+class WorldFusion
+{
+public:
+    //windowMs: how far from the reference view another camera's view may be. matchDistance: meters between two views of
+    //  the same person. minConfidence: joints below this are treated as missing.
+    WorldFusion(const std::vector<rs2_extrinsics>& cameraPoses, double windowMs = 50, float matchDistance = 0.3f, float minConfidence = 0.05f);
+
+    //Adds one camera's keypoint file (with *_keypoints_3d arrays) taken at timeMs. True if it produced a world frame in fused.
+    //  False without using it if the camera's latest view is newer.
+    bool addView(int camera, double timeMs, const nlohmann::json& document, nlohmann::json& fused);
+
+    unsigned long long framesFused() const { return frames; }
+    unsigned long long lateViews() const { return late; } //Dropped for arriving after a newer view of their camera
+
+private:
+    struct Part
+    {
+        std::string name; //e.g. pose_keypoints_3d
+        std::vector<float> joints; //x, y, z, confidence in world coordinates
+    };
+
+    struct Person
+    {
+        std::vector<Part> parts;
+    };
+
+    struct View
+    {
+        bool valid = false;
+        double timeMs = 0;
+        std::vector<Person> people;
+    };
+
+    //A person in the world frame, built up from the views that matched them
+    struct Merged
+    {
+        std::vector<std::string> names;
+        std::vector<std::vector<double>> sums; //Per part: x*w, y*w, z*w, w per joint
+        std::vector<std::vector<float>> bestConfidence; //Per part, per joint
+        Person mean; //The weighted mean so far, what the next view is matched against
+        int views = 0;
+    };
+
+    void toWorld(int camera, const nlohmann::json& document, View& view) const;
+    float distance(const Person& a, const Person& b) const; //Average joint distance, infinity if too few joints in common
+    void merge(Merged& merged, const Person& person) const;
+
+    std::vector<rs2_extrinsics> poses;
+    std::vector<View> latest; //Per camera
+    double window;
+    float maxDistance;
+    float confidenceFloor;
+    unsigned long long frames = 0;
+    unsigned long long late = 0;
+};
+
+
+
+inline WorldFusion::WorldFusion(const std::vector<rs2_extrinsics>& cameraPoses, double windowMs, float matchDistance, float minConfidence)
+    : poses(cameraPoses), latest(cameraPoses.size()), window(windowMs), maxDistance(matchDistance), confidenceFloor(minConfidence)
+{
+}//WorldFusion()
+
+
+
+inline void WorldFusion::toWorld(int camera, const nlohmann::json& document, View& view) const
+{
+    view.people.clear();
+    auto people = document.find("people");
+    if (people == document.end())
+    {
+        return;
+    }
+
+    for (const nlohmann::json& person : *people)
+    {
+        Person worldPerson;
+        int jointsSeen = 0;
+        for (auto item = person.begin(); item != person.end(); ++item)
+        {
+            const std::string& key = item.key();
+            if (key.size() < 13 || key.compare(key.size() - 13, 13, "_keypoints_3d") != 0)
+            {
+                continue;
+            }
+
+            Part part;
+            part.name = key;
+            part.joints.assign(item->size(), 0.0f);
+            for (size_t j = 0; j + 3 < item->size(); j += 4)
+            {
+                float confidence = (*item)[j + 3].get<float>();
+                if (confidence < confidenceFloor || (*item)[j + 2].get<float>() <= 0) //Missing, or no depth behind it
+                {
+                    continue;
+                }
+                float point[3] = { (*item)[j].get<float>(), (*item)[j + 1].get<float>(), (*item)[j + 2].get<float>() };
+                rs2_transform_point_to_point(&part.joints[j], &poses[camera], point);
+                part.joints[j + 3] = confidence;
+                jointsSeen++;
+            }
+            worldPerson.parts.push_back(std::move(part));
+        }
+        if (jointsSeen > 0) //Nobody to place without any depth
+        {
+            view.people.push_back(std::move(worldPerson));
+        }
+    }
+}//toWorld()
+
+
+
+inline float WorldFusion::distance(const Person& a, const Person& b) const
+{
+    float total = 0;
+    int shared = 0;
+    for (const Part& partA : a.parts)
+    {
+        for (const Part& partB : b.parts)
+        {
+            if (partA.name != partB.name)
+            {
+                continue;
+            }
+            size_t count = std::min(partA.joints.size(), partB.joints.size());
+            for (size_t j = 0; j + 3 < count; j += 4)
+            {
+                if (partA.joints[j + 3] > 0 && partB.joints[j + 3] > 0)
+                {
+                    float dx = partA.joints[j] - partB.joints[j];
+                    float dy = partA.joints[j + 1] - partB.joints[j + 1];
+                    float dz = partA.joints[j + 2] - partB.joints[j + 2];
+                    total += std::sqrt(dx * dx + dy * dy + dz * dz);
+                    shared++;
+                }
+            }
+        }
+    }
+    return shared >= 3 ? total / shared : std::numeric_limits<float>::infinity(); //A couple of joints could be anyone
+}//distance()
+
+
+
+inline void WorldFusion::merge(Merged& merged, const Person& person) const
+{
+    for (const Part& part : person.parts)
+    {
+        size_t index = std::find(merged.names.begin(), merged.names.end(), part.name) - merged.names.begin();
+        if (index == merged.names.size()) //First time this part was seen
+        {
+            merged.names.push_back(part.name);
+            merged.sums.emplace_back(part.joints.size(), 0.0);
+            merged.bestConfidence.emplace_back(part.joints.size() / 4, 0.0f);
+            merged.mean.parts.push_back({ part.name, std::vector<float>(part.joints.size(), 0.0f) });
+        }
+
+        std::vector<double>& sums = merged.sums[index];
+        std::vector<float>& mean = merged.mean.parts[index].joints;
+        size_t count = std::min(sums.size(), part.joints.size());
+        for (size_t j = 0; j + 3 < count; j += 4)
+        {
+            float weight = part.joints[j + 3];
+            if (weight <= 0)
+            {
+                continue;
+            }
+            sums[j] += weight * part.joints[j];
+            sums[j + 1] += weight * part.joints[j + 1];
+            sums[j + 2] += weight * part.joints[j + 2];
+            sums[j + 3] += weight;
+            merged.bestConfidence[index][j / 4] = std::max(merged.bestConfidence[index][j / 4], weight);
+
+            mean[j] = (float)(sums[j] / sums[j + 3]);
+            mean[j + 1] = (float)(sums[j + 1] / sums[j + 3]);
+            mean[j + 2] = (float)(sums[j + 2] / sums[j + 3]);
+            mean[j + 3] = merged.bestConfidence[index][j / 4];
+        }
+    }
+    merged.views++;
+}//merge()
+
+
+
+inline bool WorldFusion::addView(int camera, double timeMs, const nlohmann::json& document, nlohmann::json& fused)
+{
+    View& view = latest[camera];
+    if (view.valid && timeMs < view.timeMs) //Overtaken by a newer file of the same camera
+    {
+        late++;
+        return false;
+    }
+    toWorld(camera, document, view);
+    view.valid = true;
+    view.timeMs = timeMs;
+    if (camera != 0) //Only the reference camera produces world frames
+    {
+        return false;
+    }
+
+    //Every person the reference camera sees, then the other cameras' people matched to them or added
+    std::vector<Merged> world;
+    for (const Person& person : view.people)
+    {
+        world.emplace_back();
+        merge(world.back(), person);
+    }
+
+    int viewsUsed = 1;
+    for (size_t other = 1; other < latest.size(); other++)
+    {
+        const View& otherView = latest[other];
+        if (!otherView.valid || std::fabs(otherView.timeMs - timeMs) > window)
+        {
+            continue;
+        }
+        viewsUsed++;
+
+        //Closest pairs first
+        std::vector<std::pair<float, std::pair<size_t, size_t>>> pairs; //Distance, (world person, view person)
+        for (size_t w = 0; w < world.size(); w++)
+        {
+            for (size_t p = 0; p < otherView.people.size(); p++)
+            {
+                float gap = distance(world[w].mean, otherView.people[p]);
+                if (gap <= maxDistance)
+                {
+                    pairs.push_back({ gap, { w, p } });
+                }
+            }
+        }
+        std::sort(pairs.begin(), pairs.end(), [](const std::pair<float, std::pair<size_t, size_t>>& a, const std::pair<float, std::pair<size_t, size_t>>& b) {
+            return a.first < b.first || (a.first == b.first && a.second < b.second); //Ties broken by index so the result never depends on the sort
+        });
+
+        std::vector<bool> worldTaken(world.size(), false);
+        std::vector<bool> personTaken(otherView.people.size(), false);
+        for (const auto& pair : pairs)
+        {
+            if (worldTaken[pair.second.first] || personTaken[pair.second.second])
+            {
+                continue;
+            }
+            merge(world[pair.second.first], otherView.people[pair.second.second]);
+            worldTaken[pair.second.first] = true;
+            personTaken[pair.second.second] = true;
+        }
+        for (size_t p = 0; p < otherView.people.size(); p++)
+        {
+            if (!personTaken[p]) //Only this camera sees them (so far)
+            {
+                world.emplace_back();
+                merge(world.back(), otherView.people[p]);
+            }
+        }
+    }
+
+    fused = nlohmann::json::object();
+    fused["time_ms"] = timeMs;
+    fused["views"] = viewsUsed;
+    fused["people"] = nlohmann::json::array();
+    for (const Merged& merged : world)
+    {
+        nlohmann::json person;
+        for (const Part& part : merged.mean.parts)
+        {
+            person[part.name] = part.joints;
+        }
+        person["views"] = merged.views;
+        fused["people"].push_back(std::move(person));
+    }
+    frames++;
+    return true;
+}//addView()
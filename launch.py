@@ -12,6 +12,8 @@ import time #For sleep
 import os #For output cleanup
 import sys #Get command line arguments
 import keyboard #For keypress to stop program
+import socket #For the ready signal from RealSense to OpenPose 3D
+import json #For the startup timings in the ready signal
 
 ##Defaults
 #Paths
@@ -31,6 +33,8 @@ viewerExtra = "" #Extra cli arguments to modify the viewer's behavior
 quitKey = "q"
 #Camera Resolution
 colorResoultion = "1920x1080"
+#Ready Signal
+readyTimeout = 60 #Seconds to wait for the ready signal before falling back to watching ready.txt
 
 #Define Parse Command
 #Parses the command line arguments to get the number of held frames and whether to start the viewer or not
@@ -102,21 +106,38 @@ if __name__ == '__main__':
 		
 	#Start RealSense to OpenPose 3D
 	print("Starting Realsense to OpenPose 3D in a new window...")
-	realsense2OpenPoseProc = subprocess.Popen([RealSense2OpenPoseEXE, openPoseOutputPath, colorResoultion], creationflags=subprocess.CREATE_NEW_CONSOLE)
+	readyListener = socket.socket(socket.AF_INET, socket.SOCK_STREAM) #RealSense to OpenPose 3D connects here the moment the color camera is free
+	readyListener.bind(("127.0.0.1", 0)) #Any free port, only reachable from this machine
+	readyListener.listen(1)
+	readyListener.settimeout(readyTimeout)
+	readyPort = readyListener.getsockname()[1]
+	realsense2OpenPoseProc = subprocess.Popen([RealSense2OpenPoseEXE, openPoseOutputPath, colorResoultion, "ready=" + str(readyPort)], creationflags=subprocess.CREATE_NEW_CONSOLE)
 	print("Started Realsense to OpenPose 3D")
 
-	#Wait a little bit for the color camera to be ready for use by OpenPose
-	time.sleep(1)
+	#Wait for the color camera to be ready for use by OpenPose
+	cameraReady = False
+	try:
+		readyConnection, address = readyListener.accept()
+		readyConnection.settimeout(5)
+		readyMessage = readyConnection.makefile().readline()
+		readyConnection.close()
+		timings = json.loads(readyMessage)["timings_ms"]
+		cameraTimes = ", ".join(camera["name"] + " " + str(round(camera["ms"])) + " ms (" + camera["source"] + ")" for camera in timings["cameras"])
+		print("Camera ready after " + str(round(timings["total"])) + " ms: arguments " + str(round(timings["arguments"])) + " ms, " + cameraTimes)
+		cameraReady = True
+	except (OSError, ValueError, KeyError): #No signal (e.g. an older RS2OP3D.exe), socket.timeout is an OSError
+		print("No ready signal, watching ready.txt instead")
+	readyListener.close()
 
-	cameraReady = ['false']
-
-	while(cameraReady[0] == "false"):
+	while(not cameraReady):
 		#check if the color camera is ready
-		readyInput = open(openPoseOutputPath + "/ready.txt")
-		cameraReady = readyInput.readlines()
-		readyInput.close()
-
 		time.sleep(0.2) #If camera not yet ready, wait a little bit more
+		try:
+			readyInput = open(openPoseOutputPath + "/ready.txt")
+			cameraReady = readyInput.read().strip() == "true"
+			readyInput.close()
+		except OSError: #Not created yet
+			pass
 
 	#Once the camera is ready, start OpenPose
 	print("Starting OpenPose in a new window...")